@@ -0,0 +1,113 @@
+#include <assert.h>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+#include "Arena.h"
+
+using namespace std;
+
+//*************************************************
+//count every heap allocation made from our code so we can see if a frame churns,
+//per thread so the simulator's workers aren't all fighting over one counter
+static thread_local unsigned heapAllocs = 0;
+
+void* operator new(size_t bytes)
+{
+	++heapAllocs;
+	if (void *p = malloc(bytes ? bytes : 1))
+		return p;
+	throw bad_alloc();
+}
+
+void* operator new[](size_t bytes)
+{
+	return operator new(bytes);
+}
+
+void operator delete(void *p) noexcept
+{
+	free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+	free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+	free(p);
+}
+
+void operator delete[](void *p, size_t) noexcept
+{
+	free(p);
+}
+
+unsigned GetHeapAllocCount()
+{
+	return heapAllocs;
+}
+
+//*************************************************
+Arena::Arena(size_t bytes)
+	: size(bytes)
+{
+	pBlock = static_cast<char*>(malloc(size));
+	assert(pBlock);
+}
+
+Arena::~Arena()
+{
+	for (char *p : overflow)
+		free(p);
+	free(pBlock);
+}
+
+void* Arena::Alloc(size_t bytes, size_t align)
+{
+	size_t start = (used + align - 1) & ~(align - 1);
+	if (start + bytes <= size) {
+		used = start + bytes;
+		return pBlock + start;
+	}
+	//out of room, borrow from the heap until the next reset
+	overflowBytes += bytes + align;
+	char *p = static_cast<char*>(malloc(bytes + align));
+	assert(p);
+	overflow.push_back(p);
+	size_t addr = reinterpret_cast<size_t>(p);
+	return p + (((addr + align - 1) & ~(align - 1)) - addr);
+}
+
+void Arena::Reset()
+{
+	if (overflowBytes) {
+		//grow so next time it all fits in one block
+		for (char *p : overflow)
+			free(p);
+		overflow.clear();
+		free(pBlock);
+		size += overflowBytes;
+		pBlock = static_cast<char*>(malloc(size));
+		assert(pBlock);
+		overflowBytes = 0;
+	}
+	used = 0;
+}
+
+Arena& GetFrameArena()
+{
+	static thread_local Arena arena;
+	return arena;
+}
+
+//*************************************************
+FrameText& FrameText::operator<<(int val)
+{
+	char buf[16];
+	snprintf(buf, sizeof(buf), "%d", val);
+	str += buf;
+	return *this;
+}
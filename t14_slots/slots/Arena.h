@@ -0,0 +1,85 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+/*
+A block of memory handed out front to back and thrown away in one go.
+Nothing is freed individually, Reset() makes the whole block available again.
+If a frame needs more than the block holds the extra comes from the heap and
+the block is grown to fit at the next Reset(), so after a few frames we stop
+touching the heap altogether.
+*/
+struct Arena
+{
+	explicit Arena(size_t bytes = 64 * 1024);
+	~Arena();
+	Arena(const Arena&) = delete;
+	Arena& operator=(const Arena&) = delete;
+
+	//grab some memory, it lives until the next Reset
+	void* Alloc(size_t bytes, size_t align);
+	//everything handed out so far is now invalid
+	void Reset();
+
+	char *pBlock = nullptr;			//the main block
+	size_t size = 0;				//how big the main block is
+	size_t used = 0;				//how much of it has been handed out
+	std::vector<char*> overflow;	//extra heap blocks when the main one ran out
+	size_t overflowBytes = 0;		//how much we needed on top of the main block
+};
+
+//one arena per thread, reset once a frame by whoever owns the frame
+Arena& GetFrameArena();
+
+/*
+Standard allocator that takes its memory from an arena, deallocate does nothing.
+Defaults to the frame arena so FrameString/FrameVector can be declared like
+normal strings and vectors.
+*/
+template<class T>
+struct ArenaAllocator
+{
+	typedef T value_type;
+	Arena *pArena;
+
+	ArenaAllocator() : pArena(&GetFrameArena()) {}
+	ArenaAllocator(Arena& arena) : pArena(&arena) {}
+	template<class U>
+	ArenaAllocator(const ArenaAllocator<U>& other) : pArena(other.pArena) {}
+
+	T* allocate(size_t n) {
+		return static_cast<T*>(pArena->Alloc(n * sizeof(T), alignof(T)));
+	}
+	void deallocate(T*, size_t) {}
+
+	template<class U>
+	bool operator==(const ArenaAllocator<U>& other) const { return pArena == other.pArena; }
+	template<class U>
+	bool operator!=(const ArenaAllocator<U>& other) const { return pArena != other.pArena; }
+};
+
+typedef std::basic_string<char, std::char_traits<char>, ArenaAllocator<char>> ArenaString;
+typedef ArenaString FrameString;
+template<class T>
+using FrameVector = std::vector<T, ArenaAllocator<T>>;
+
+/*
+Build up some text in the frame arena, a stand-in for stringstream
+that doesn't touch the heap
+*/
+struct FrameText
+{
+	FrameString str;
+
+	FrameText& operator<<(const char *pTxt) { str += pTxt; return *this; }
+	FrameText& operator<<(const std::string& txt) { str.append(txt.c_str(), txt.length()); return *this; }
+	FrameText& operator<<(const FrameString& txt) { str += txt; return *this; }
+	FrameText& operator<<(char c) { str += c; return *this; }
+	FrameText& operator<<(int val);
+	FrameText& operator<<(size_t val) { return *this << (int)val; }
+	const char* c_str() const { return str.c_str(); }
+};
+
+//how many times operator new has been called on this thread since it started
+unsigned GetHeapAllocCount();
@@ -0,0 +1,92 @@
+#include <assert.h>
+
+#include "DBPool.h"
+#include "Utils.h"
+
+using namespace std;
+
+DBPool::Lease& DBPool::Lease::operator=(Lease&& other)
+{
+	if (this != &other) {
+		Release();
+		pPool = other.pPool;
+		pDB = other.pDB;
+		other.pDB = nullptr;
+	}
+	return *this;
+}
+
+void DBPool::Lease::Release()
+{
+	if (pDB) {
+		pDB->ClearResults();
+		pPool->GiveBack(pDB);
+		pDB = nullptr;
+	}
+}
+
+bool DBPool::Open(const string& fileName, int numReaders, const DBTuning& tuning)
+{
+	assert(!writer && numReaders > 0);
+	//the writer goes first so the file is in WAL mode before anyone reads it
+	writer.reset(new MyDB);
+	if (!writer->OpenShared(fileName, false, tuning)) {
+		writer.reset();
+		return false;
+	}
+	for (int i = 0; i < numReaders; ++i) {
+		readers.emplace_back(new MyDB);
+		if (!readers.back()->OpenShared(fileName, true, tuning)) {
+			readers.pop_back();
+			Close();
+			return false;
+		}
+		freeReaders.push_back(readers.back().get());
+	}
+	return true;
+}
+
+void DBPool::Close()
+{
+	unique_lock<mutex> lock(mtx);
+	returned.wait(lock, [this] { return !writerOut && freeReaders.size() == readers.size(); });
+	for (auto& pDB : readers)
+		pDB->Close();
+	readers.clear();
+	freeReaders.clear();
+	if (writer)
+		writer->Close();
+	writer.reset();
+}
+
+DBPool::Lease DBPool::Read()
+{
+	unique_lock<mutex> lock(mtx);
+	assert(!readers.empty());
+	returned.wait(lock, [this] { return !freeReaders.empty(); });
+	MyDB *pDB = freeReaders.back();
+	freeReaders.pop_back();
+	return Lease(this, pDB);
+}
+
+DBPool::Lease DBPool::Write()
+{
+	unique_lock<mutex> lock(mtx);
+	assert(writer);
+	returned.wait(lock, [this] { return !writerOut; });
+	writerOut = true;
+	return Lease(this, writer.get());
+}
+
+void DBPool::GiveBack(MyDB *pDB)
+{
+	{
+		lock_guard<mutex> lock(mtx);
+		if (pDB == writer.get())
+			writerOut = false;
+		else
+			freeReaders.push_back(pDB);
+	}
+	//readers and the writer share the condition so wake everyone, there are only a handful
+	returned.notify_all();
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "MyDB.h"
+
+/*
+Lets lots of threads use one database file at once, for the leaderboard server.
+There is one writer connection and a pool of read-only ones, all in WAL mode,
+so reads run in parallel on every core and never wait for a commit. A thread
+borrows a connection, uses it and gives it back when the Lease goes out of scope.
+Only one thread can hold the writer at a time.
+*/
+class DBPool
+{
+public:
+	//a borrowed connection, goes back to the pool when this is destroyed
+	class Lease
+	{
+	public:
+		Lease() = default;
+		Lease(Lease&& other) : pPool(other.pPool), pDB(other.pDB) { other.pDB = nullptr; }
+		Lease& operator=(Lease&& other);
+		~Lease() { Release(); }
+		MyDB* operator->() { return pDB; }
+		MyDB& operator*() { return *pDB; }
+		explicit operator bool() const { return pDB != nullptr; }
+		void Release();
+
+	private:
+		friend class DBPool;
+		Lease(DBPool *pPool, MyDB *pDB) : pPool(pPool), pDB(pDB) {}
+		DBPool *pPool = nullptr;
+		MyDB *pDB = nullptr;
+	};
+
+	~DBPool() { Close(); }
+	//open the writer (switching the file to WAL) then numReaders read-only connections
+	bool Open(const std::string& fileName, int numReaders, const DBTuning& tuning = DBTuning());
+	//waits for everything to be given back then closes it all
+	void Close();
+	//borrow a read-only connection, waits if they're all out
+	Lease Read();
+	//borrow the writer, waits if another thread has it
+	Lease Write();
+	int NumReaders() const { return (int)readers.size(); }
+
+private:
+	void GiveBack(MyDB *pDB);
+
+	std::mutex mtx;
+	std::condition_variable returned;
+	std::unique_ptr<MyDB> writer;
+	bool writerOut = false;
+	std::vector<std::unique_ptr<MyDB>> readers;
+	std::vector<MyDB*> freeReaders;
+};
@@ -0,0 +1,341 @@
+#include <assert.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include "DBTransfer.h"
+#include "MyDB.h"
+#include "Utils.h"
+
+using namespace std;
+
+namespace {
+	const char MAGIC[] = "SLOTSPLR";
+	const unsigned char VERSION = 2;
+	const size_t IO_BUFFER = 1 << 20;	//big stdio buffers, we're always going front to back
+	const int BATCH_ROWS = 100000;		//rows per transaction on import
+	const int MAX_LINE = 4096;
+
+	//one player as it travels between machines
+	struct PlayerRecord {
+		string name;
+		long long score = 0;
+		bool hasPlays = false;
+		long long plays = 0;
+		long long nudges = 0;
+	};
+
+	//*************************************************
+	//binary helpers
+	void PutVarint(FILE *f, unsigned long long v)
+	{
+		while (v >= 0x80) {
+			putc((int)(v & 0x7f) | 0x80, f);
+			v >>= 7;
+		}
+		putc((int)v, f);
+	}
+
+	bool GetVarint(FILE *f, unsigned long long& v)
+	{
+		v = 0;
+		for (int shift = 0; shift < 64; shift += 7) {
+			int c = getc(f);
+			if (c == EOF)
+				return false;
+			v |= (unsigned long long)(c & 0x7f) << shift;
+			if (!(c & 0x80))
+				return true;
+		}
+		return false;
+	}
+
+	unsigned long long ZigZag(long long v)
+	{
+		return ((unsigned long long)v << 1) ^ (unsigned long long)(v >> 63);
+	}
+
+	long long UnZigZag(unsigned long long v)
+	{
+		return (long long)(v >> 1) ^ -(long long)(v & 1);
+	}
+
+	void WriteBinary(FILE *f, const PlayerRecord& rec)
+	{
+		PutVarint(f, rec.name.length() + 1);
+		fwrite(rec.name.data(), 1, rec.name.length(), f);
+		PutVarint(f, ZigZag(rec.score));
+		PutVarint(f, rec.hasPlays ? (unsigned long long)rec.plays + 1 : 0);
+		PutVarint(f, rec.hasPlays ? (unsigned long long)rec.nudges : 0);
+	}
+
+	//false at the end marker, 'bad' is set if the file is broken
+	bool ReadBinary(FILE *f, unsigned char version, PlayerRecord& rec, bool& bad)
+	{
+		unsigned long long len, score, plays, nudges;
+		if (!GetVarint(f, len) || len > MAX_LINE) {
+			bad = true;
+			return false;
+		}
+		if (len == 0)
+			return false;
+		if (version >= 2)
+			--len;
+		rec.name.resize((size_t)len);
+		if ((len && fread(&rec.name[0], 1, (size_t)len, f) != len) || !GetVarint(f, score) || !GetVarint(f, plays) || !GetVarint(f, nudges)) {
+			bad = true;
+			return false;
+		}
+		rec.score = UnZigZag(score);
+		rec.hasPlays = plays > 0;
+		rec.plays = plays ? (long long)plays - 1 : 0;
+		rec.nudges = (long long)nudges;
+		return true;
+	}
+
+	//*************************************************
+	//csv helpers, quote anything with a comma, quote or line break in it, and empty names so they aren't a missing field
+	void WriteCSVField(FILE *f, const string& txt)
+	{
+		if (!txt.empty() && txt.find_first_of(",\"\r\n") == string::npos) {
+			fwrite(txt.data(), 1, txt.length(), f);
+			return;
+		}
+		putc('"', f);
+		for (char c : txt) {
+			if (c == '"')
+				putc('"', f);
+			putc(c, f);
+		}
+		putc('"', f);
+	}
+
+	void WriteCSV(FILE *f, const PlayerRecord& rec)
+	{
+		WriteCSVField(f, rec.name);
+		if (rec.hasPlays)
+			fprintf(f, ",%lld,%lld,%lld\n", rec.score, rec.plays, rec.nudges);
+		else
+			fprintf(f, ",%lld,,\n", rec.score);
+	}
+
+	//split one line into at most maxFields, returns how many there were
+	int SplitCSV(char *pLine, string *fields, int maxFields)
+	{
+		int n = 0;
+		char *p = pLine;
+		while (n < maxFields) {
+			string& fld = fields[n++];
+			fld.clear();
+			if (*p == '"') {
+				++p;
+				while (*p && !(*p == '"' && p[1] != '"')) {
+					if (*p == '"')
+						++p;	//doubled quote
+					fld += *p++;
+				}
+				if (*p == '"')
+					++p;
+			}
+			else
+				while (*p && *p != ',' && *p != '\n' && *p != '\r')
+					fld += *p++;
+			if (*p != ',')
+				break;
+			++p;
+		}
+		return n;
+	}
+
+	//one record, a quoted name with a line break in it carries on over the next line
+	bool ReadCSV(FILE *f, char *pLine, PlayerRecord& rec, bool& bad)
+	{
+		string fields[4];
+		string record;
+		while (fgets(pLine, MAX_LINE, f)) {
+			if (record.empty() && (pLine[0] == '\n' || pLine[0] == '\r' || pLine[0] == 0))
+				continue;
+			record += pLine;
+			//an odd number of quotes so far means a quoted field is still open
+			if (count(record.begin(), record.end(), '"') % 2 != 0) {
+				if (record.length() < MAX_LINE)
+					continue;
+				bad = true;
+				return false;
+			}
+			//an empty name has to be quoted, a bare one is a broken line
+			if (SplitCSV(&record[0], fields, 4) != 4 || (fields[0].empty() && record[0] != '"')) {
+				bad = true;
+				return false;
+			}
+			rec.name = fields[0];
+			rec.score = strtoll(fields[1].c_str(), nullptr, 10);
+			rec.hasPlays = !fields[2].empty();
+			rec.plays = strtoll(fields[2].c_str(), nullptr, 10);
+			rec.nudges = strtoll(fields[3].c_str(), nullptr, 10);
+			return true;
+		}
+		//ran out in the middle of a quoted name
+		if (!record.empty())
+			bad = true;
+		return false;
+	}
+}
+
+TransferFormat FormatFromFileName(const string& fileName)
+{
+	size_t dot = fileName.find_last_of('.');
+	if (dot != string::npos && (fileName.substr(dot) == ".csv" || fileName.substr(dot) == ".CSV"))
+		return TransferFormat::CSV;
+	return TransferFormat::BINARY;
+}
+
+long long ExportPlayers(const string& dbFile, const string& outFile, TransferFormat fmt)
+{
+	MyDB db;
+	if (!db.OpenFile(dbFile, true))
+		return -1;
+	FILE *f = fopen(outFile.c_str(), fmt == TransferFormat::CSV ? "w" : "wb");
+	if (!f) {
+		DebugPrint("Cannot write to ", outFile);
+		db.Close();
+		return -1;
+	}
+	setvbuf(f, nullptr, _IOFBF, IO_BUFFER);
+	if (fmt == TransferFormat::CSV)
+		fputs("NAME,SCORE,TOTAL_PLAYS,TOTAL_NUDGES\n", f);
+	else {
+		fwrite(MAGIC, 1, sizeof(MAGIC) - 1, f);
+		putc(VERSION, f);
+	}
+
+	//step through the rows ourselves rather than collecting them all in results
+	sqlite3_stmt *pStmt = nullptr;
+	long long count = 0;
+	int rc = sqlite3_prepare_v2(db.pDB, "SELECT H.NAME, H.SCORE, P.TOTAL_PLAYS, P.TOTAL_NUDGES "
+		"FROM HIGHSCORES H LEFT JOIN PLAYS P ON P.HIGHSCORE_ID = H.ID", -1, &pStmt, nullptr);
+	if (rc == SQLITE_OK) {
+		PlayerRecord rec;
+		while ((rc = sqlite3_step(pStmt)) == SQLITE_ROW) {
+			const char *pName = reinterpret_cast<const char*>(sqlite3_column_text(pStmt, 0));
+			rec.name = pName ? pName : "";
+			rec.score = sqlite3_column_int64(pStmt, 1);
+			rec.hasPlays = sqlite3_column_type(pStmt, 2) != SQLITE_NULL;
+			rec.plays = sqlite3_column_int64(pStmt, 2);
+			rec.nudges = sqlite3_column_int64(pStmt, 3);
+			if (fmt == TransferFormat::CSV)
+				WriteCSV(f, rec);
+			else
+				WriteBinary(f, rec);
+			++count;
+		}
+	}
+	if (rc != SQLITE_DONE) {
+		DebugPrint("SQL error: ", sqlite3_errmsg(db.pDB));
+		count = -1;
+	}
+	sqlite3_finalize(pStmt);
+	db.Close();
+
+	if (fmt == TransferFormat::BINARY) {
+		putc(0, f);
+		PutVarint(f, count < 0 ? 0 : count);
+	}
+	if (fclose(f) != 0) {
+		DebugPrint("Cannot write to ", outFile);
+		return -1;
+	}
+	return count;
+}
+
+long long ImportPlayers(const string& dbFile, const string& inFile, TransferFormat fmt, bool& complete)
+{
+	complete = false;
+	FILE *f = fopen(inFile.c_str(), fmt == TransferFormat::CSV ? "r" : "rb");
+	if (!f) {
+		DebugPrint("Cannot read ", inFile);
+		return -1;
+	}
+	setvbuf(f, nullptr, _IOFBF, IO_BUFFER);
+	char line[MAX_LINE];
+	bool bad = false;
+	unsigned char version = VERSION;
+	if (fmt == TransferFormat::CSV) {
+		//skip the header
+		if (!fgets(line, MAX_LINE, f) || strncmp(line, "NAME,", 5) != 0)
+			bad = true;
+	}
+	else {
+		char magic[sizeof(MAGIC)] = {};
+		if (fread(magic, 1, sizeof(MAGIC), f) != sizeof(MAGIC) || memcmp(magic, MAGIC, sizeof(MAGIC) - 1) != 0)
+			bad = true;
+		version = (unsigned char)magic[sizeof(MAGIC) - 1];
+		if (version < 1 || version > VERSION)
+			bad = true;
+	}
+	MyDB db;
+	if (bad || !db.OpenFile(dbFile, false)) {
+		DebugPrint("Cannot import ", inFile);
+		fclose(f);
+		return -1;
+	}
+	CreatePlayerTables(db);
+	db.ExecQuery("PRAGMA synchronous = NORMAL");
+	db.ExecQuery("PRAGMA cache_size = -65536");	//64MB, keeps the indices we are inserting into in memory
+
+	//one NAME lookup per player, then everything else goes by ID: existing players are updated
+	//through the rowid and new ones get theirs from the insert, so PLAYS never searches by name
+	MyDB::Query& findPlayer = db.Prepare("SELECT ID FROM HIGHSCORES WHERE NAME = ?1");
+	MyDB::Query& updatePlayer = db.Prepare("UPDATE HIGHSCORES SET SCORE = ?2, SEQ = ?3 WHERE ID = ?1");
+	MyDB::Query& addPlayer = db.Prepare("INSERT INTO HIGHSCORES (NAME, SCORE, SEQ) VALUES (?1, ?2, ?3)");
+	//what NEXT_HIGHSCORE_SEQ would give each row, nobody else can write while a batch holds the transaction
+	MyDB::Query& lastSeq = db.Prepare("SELECT IFNULL(MAX(SEQ), 0) AS SEQ FROM HIGHSCORES");
+	long long seq = 0;
+	MyDB::Query& addPlays = db.Prepare("INSERT INTO PLAYS (HIGHSCORE_ID, TOTAL_PLAYS, TOTAL_NUDGES) VALUES (?1, ?2, ?3) "
+		"ON CONFLICT(HIGHSCORE_ID) DO UPDATE SET TOTAL_PLAYS = excluded.TOTAL_PLAYS, TOTAL_NUDGES = excluded.TOTAL_NUDGES");
+	long long count = 0, committed = 0;
+	PlayerRecord rec;
+	bool ok = db.Begin() && db.Exec(lastSeq);
+	if (ok)
+		seq = strtoll(db.GetStr(0, "SEQ").c_str(), nullptr, 10);
+	while (ok && (fmt == TransferFormat::CSV ? ReadCSV(f, line, rec, bad) : ReadBinary(f, version, rec, bad))) {
+		long long id = 0;
+		ok = db.Exec(findPlayer.Bind(1, rec.name));
+		if (ok && !db.results.empty()) {
+			id = strtoll(db.GetStr(0, "ID").c_str(), nullptr, 10);
+			ok = db.Exec(updatePlayer.Bind(1, id).Bind(2, rec.score).Bind(3, ++seq));
+		}
+		else if (ok) {
+			ok = db.Exec(addPlayer.Bind(1, rec.name).Bind(2, rec.score).Bind(3, ++seq));
+			id = sqlite3_last_insert_rowid(db.pDB);
+		}
+		if (ok && rec.hasPlays)
+			ok = db.Exec(addPlays.Bind(1, id).Bind(2, rec.plays).Bind(3, rec.nudges));
+		//commit every so often so the journal doesn't grow without limit
+		if (ok && ++count % BATCH_ROWS == 0) {
+			ok = db.Commit();
+			if (ok)
+				committed = count;
+			ok = ok && db.Begin() && db.Exec(lastSeq);
+			if (ok)
+				seq = strtoll(db.GetStr(0, "SEQ").c_str(), nullptr, 10);
+		}
+	}
+	if (ok && fmt == TransferFormat::BINARY && !bad) {
+		unsigned long long expected;
+		if (!GetVarint(f, expected) || expected != (unsigned long long)count)
+			bad = true;
+	}
+	fclose(f);
+	if (ok && !bad)
+		ok = db.Commit();
+	else
+		db.Rollback();
+	db.Close();
+	if (!ok || bad) {
+		DebugPrint("Import failed partway through ", inFile);
+		return committed;
+	}
+	complete = true;
+	return count;
+}
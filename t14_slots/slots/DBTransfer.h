@@ -0,0 +1,33 @@
+#pragma once
+
+#include <string>
+
+/*
+Move players between machines without copying whole database files.
+One record per player: name, score and (if they have one) their PLAYS row.
+Both directions stream a row at a time so memory use doesn't depend on
+how many players there are, imports go in big transactions through
+prepared statements.
+The binary format is:
+	"SLOTSPLR" then a version byte
+	per player: varint name length + 1, name bytes, zigzag varint score,
+	varint total plays + 1 (0 = no PLAYS row), varint total nudges
+	a zero then a varint count of players to finish
+Version 1 files stored the name length as is, so couldn't hold an empty name,
+they can still be imported.
+*/
+enum class TransferFormat { CSV, BINARY };
+
+//.csv files are text, anything else is binary
+TransferFormat FormatFromFileName(const std::string& fileName);
+
+//write every player in dbFile out, returns how many or -1 if it went wrong
+long long ExportPlayers(const std::string& dbFile, const std::string& outFile, TransferFormat fmt);
+
+/*
+Read players in, new names are added and existing ones overwritten. Big imports
+are committed in batches, so if it goes wrong partway through the batches
+before stay in: complete is false and the return value is how many players
+did go in. -1 if nothing could be read at all.
+*/
+long long ImportPlayers(const std::string& dbFile, const std::string& inFile, TransferFormat fmt, bool& complete);
@@ -0,0 +1,243 @@
+#include <assert.h>
+#include <cmath>
+#include <memory>
+
+#include "Fairness.h"
+#include "Parallel.h"
+
+using namespace std;
+
+//outcomes per block, each block is one sequence on its own random stream
+static const uint64_t FAIRNESS_BLOCK = 1 << 22;
+
+
+namespace {
+	//how many different fruits are in a hand, by the mask of which fruits turned up
+	struct DistinctTable {
+		uint8_t count[1 << FairnessCounters::K];
+		DistinctTable() {
+			for (unsigned m = 0; m < sizeof(count); ++m) {
+				count[m] = 0;
+				for (unsigned bits = m; bits; bits &= bits - 1)
+					++count[m];
+			}
+		}
+	} const distinct;
+}
+
+void FairnessCounters::StartSequence()
+{
+	seq = Sequence();
+}
+
+void FairnessCounters::Add(int x)
+{
+	Count(seq, x);
+}
+
+void FairnessCounters::Feed(RndStream& rnd, uint64_t count)
+{
+	StartSequence();
+	Sequence s = seq;
+	for (uint64_t i = 0; i < count; ++i)
+		Count(s, rnd.GetRange(0, K - 1));
+	seq = s;
+}
+
+inline void FairnessCounters::Count(Sequence& s, int x)
+{
+	assert(x >= 0 && x < K);
+	++n;
+	++freq[x];
+	if (s.pairFirst < 0)
+		s.pairFirst = x;
+	else {
+		++pairs[s.pairFirst][x];
+		s.pairFirst = -1;
+	}
+	if (s.prev >= 0) {
+		++lagPairs;
+		sumX += s.prev;
+		sumY += x;
+		sumXX += s.prev * s.prev;
+		sumYY += x * x;
+		sumXY += s.prev * x;
+	}
+	//a run is only counted when it ends, so the one still going at the end of a sequence is never counted
+	//no branch on x == prev, it goes the other way too often to predict
+	const bool same = (x == s.prev);
+	if (s.runLength > 0)
+		runs[min(s.runLength, RUN_BUCKETS) - 1] += !same;
+	s.runLength = same ? s.runLength + 1 : 1;
+	s.prev = x;
+	if (s.lastSeen[x])
+		++gaps[x][min<uint64_t>(s.pos - s.lastSeen[x], GAP_BUCKETS - 1)];
+	s.lastSeen[x] = ++s.pos;
+	s.handMask |= 1u << x;
+	if (++s.handSize == HAND) {
+		++hands[distinct.count[s.handMask] - 1];
+		s.handMask = 0;
+		s.handSize = 0;
+	}
+}
+
+void FairnessCounters::Merge(const FairnessCounters& other)
+{
+	n += other.n;
+	for (int i = 0; i < K; ++i) {
+		freq[i] += other.freq[i];
+		for (int j = 0; j < K; ++j)
+			pairs[i][j] += other.pairs[i][j];
+		for (int j = 0; j < GAP_BUCKETS; ++j)
+			gaps[i][j] += other.gaps[i][j];
+	}
+	lagPairs += other.lagPairs;
+	sumX += other.sumX;
+	sumY += other.sumY;
+	sumXX += other.sumXX;
+	sumYY += other.sumYY;
+	sumXY += other.sumXY;
+	for (int i = 0; i < RUN_BUCKETS; ++i)
+		runs[i] += other.runs[i];
+	for (int i = 0; i < HAND; ++i)
+		hands[i] += other.hands[i];
+}
+
+//*************************************************
+
+namespace {
+	//regularised upper incomplete gamma Q(a, x), series below a+1 and a continued fraction above
+	double GammaQ(double a, double x)
+	{
+		if (x <= 0)
+			return 1;
+		const double lead = exp(-x + a * log(x) - lgamma(a));
+		if (x < a + 1) {
+			double term = 1 / a, sum = term;
+			for (int i = 1; i < 10000 && fabs(term) > fabs(sum) * 1e-15; ++i) {
+				term *= x / (a + i);
+				sum += term;
+			}
+			return max(0.0, 1 - sum * lead);
+		}
+		//modified Lentz
+		const double tiny = 1e-300;
+		double b = x + 1 - a, c = 1 / tiny, d = 1 / b, h = d;
+		for (int i = 1; i < 10000; ++i) {
+			double an = -i * (i - a);
+			b += 2;
+			d = an * d + b;
+			d = fabs(d) < tiny ? tiny : d;
+			c = b + an / c;
+			c = fabs(c) < tiny ? tiny : c;
+			d = 1 / d;
+			double delta = d * c;
+			h *= delta;
+			if (fabs(delta - 1) < 1e-15)
+				break;
+		}
+		return lead * h;
+	}
+
+	//observed against expected chances, a row for the table
+	FairnessResult ChiSquare(const string& test, const uint64_t *observed, const double *chance, int numBuckets)
+	{
+		uint64_t total = 0;
+		for (int i = 0; i < numBuckets; ++i)
+			total += observed[i];
+		double chi2 = 0;
+		for (int i = 0; i < numBuckets; ++i) {
+			double expected = total * chance[i];
+			double diff = observed[i] - expected;
+			chi2 += expected > 0 ? diff * diff / expected : 0;
+		}
+		return FairnessResult{ test, chi2, numBuckets - 1, ChiSquareP(chi2, numBuckets - 1) };
+	}
+}
+
+double ChiSquareP(double chi2, int df)
+{
+	return GammaQ(df / 2.0, chi2 / 2);
+}
+
+vector<FairnessResult> FairnessResults(const FairnessCounters& c)
+{
+	typedef FairnessCounters FC;
+	const int K = FC::K;
+	const double p = 1.0 / K;
+	vector<FairnessResult> results;
+
+	double uniform[K * K];
+	for (double& u : uniform)
+		u = p;
+	results.push_back(ChiSquare("frequency", c.freq, uniform, K));
+
+	for (double& u : uniform)
+		u = p * p;
+	results.push_back(ChiSquare("pairs", &c.pairs[0][0], uniform, K * K));
+
+	//Pearson's r, n * r^2 is chi-square with 1 df for independent draws so r * sqrt(n) is a z score
+	double n = (double)c.lagPairs;
+	double cov = c.sumXY / n - (c.sumX / n) * (c.sumY / n);
+	double varX = c.sumXX / n - (c.sumX / n) * (c.sumX / n);
+	double varY = c.sumYY / n - (c.sumY / n) * (c.sumY / n);
+	double z = (varX > 0 && varY > 0) ? cov / sqrt(varX * varY) * sqrt(n) : 0;
+	results.push_back(FairnessResult{ "serial", z, 0, erfc(fabs(z) / sqrt(2.0)) });
+
+	//a run carries on with chance p each draw
+	double runChance[FC::RUN_BUCKETS];
+	for (int i = 0; i < FC::RUN_BUCKETS; ++i)
+		runChance[i] = (i < FC::RUN_BUCKETS - 1) ? pow(p, i) * (1 - p) : pow(p, i);
+	results.push_back(ChiSquare("runs", c.runs, runChance, FC::RUN_BUCKETS));
+
+	//a gap grows with chance 1 - p each draw
+	double gapChance[FC::GAP_BUCKETS];
+	for (int i = 0; i < FC::GAP_BUCKETS; ++i)
+		gapChance[i] = (i < FC::GAP_BUCKETS - 1) ? pow(1 - p, i) * p : pow(1 - p, i);
+	for (int f = 0; f < K; ++f)
+		results.push_back(ChiSquare("gap " + to_string(f), c.gaps[f], gapChance, FC::GAP_BUCKETS));
+
+	//ways to get r different fruits in a hand: Stirling(HAND, r) * K!/(K-r)! out of K^HAND
+	double stirling[FC::HAND + 1][FC::HAND + 1] = {};
+	stirling[0][0] = 1;
+	for (int i = 1; i <= FC::HAND; ++i)
+		for (int r = 1; r <= i; ++r)
+			stirling[i][r] = r * stirling[i - 1][r] + stirling[i - 1][r - 1];
+	double handChance[FC::HAND];
+	for (int r = 1; r <= FC::HAND; ++r) {
+		double ways = stirling[FC::HAND][r];
+		for (int i = 0; i < r; ++i)
+			ways *= K - i;
+		handChance[r - 1] = ways / pow((double)K, FC::HAND);
+	}
+	results.push_back(ChiSquare("poker", c.hands, handChance, FC::HAND));
+	return results;
+}
+
+bool PrintFairness(FILE *pFile, const vector<FairnessResult>& results, double alpha)
+{
+	bool pass = true;
+	fprintf(pFile, "%-10s %14s %4s %10s\n", "test", "statistic", "df", "p");
+	for (const FairnessResult& r : results) {
+		bool ok = r.p >= alpha;
+		pass = pass && ok;
+		fprintf(pFile, "%-10s %14.4f %4d %10.6f %s\n", r.test.c_str(), r.statistic, r.df, r.p, ok ? "" : "FAIL");
+	}
+	fprintf(pFile, "%s at p < %g\n", pass ? "PASSED" : "FAILED", alpha);
+	return pass;
+}
+
+FairnessCounters RunFairness(uint64_t numOutcomes, uint64_t seed, int numThreads)
+{
+	//allocated one at a time so threads counting side by side don't share cache lines
+	vector<unique_ptr<FairnessCounters>> counters;
+	for (int i = 0; i < NumWorkers(numThreads); ++i)
+		counters.emplace_back(new FairnessCounters);
+	int used = RunBlocks(numOutcomes, FAIRNESS_BLOCK, seed, (int)counters.size(), [&](int idx, RndStream& rnd, uint64_t first, uint64_t end) {
+		counters[idx]->Feed(rnd, end - first);
+	});
+	FairnessCounters total;
+	for (int i = 0; i < used; ++i)
+		total.Merge(*counters[i]);
+	return total;
+}
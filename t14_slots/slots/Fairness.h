@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "GameRules.h"
+#include "Utils.h"
+
+/*
+Statistical tests that reel outcomes are uniform and independent, for
+certification. Outcomes come from RndStream::GetRange(0, NUM_FRUIT-1), the
+same call Rnd makes for the cabinet. Each thread counts what it sees in its
+own FairnessCounters, they're merged at the end and turned into p-values.
+The counters are only ever added to so a long run can be split up any way.
+
+	frequency	each fruit comes up 1 in NUM_FRUIT
+	pairs		non-overlapping pairs, each of the NUM_FRUIT^2 equally likely
+	serial		correlation between each outcome and the next
+	runs		lengths of runs of the same fruit
+	gap			how far apart each fruit's appearances are, one test per fruit
+	poker		how many different fruits turn up on a line of NUM_REELS reels
+*/
+struct FairnessCounters
+{
+	static const int K = GC::NUM_FRUIT;		//outcomes per draw
+	static const int RUN_BUCKETS = 8;		//runs of 1..7, then 8 or longer
+	static const int GAP_BUCKETS = 40;		//gaps of 0..38, then 39 or longer
+	static const int HAND = GC::NUM_REELS;	//draws per poker hand
+
+	uint64_t n = 0;
+	uint64_t freq[K] = {};
+	uint64_t pairs[K][K] = {};
+	uint64_t lagPairs = 0;					//sums for the serial correlation of (x[i], x[i+1])
+	uint64_t sumX = 0, sumY = 0, sumXX = 0, sumYY = 0, sumXY = 0;
+	uint64_t runs[RUN_BUCKETS] = {};
+	uint64_t gaps[K][GAP_BUCKETS] = {};
+	uint64_t hands[HAND] = {};				//by number of different fruits - 1
+
+	//where we are in the current sequence, nothing carries over between sequences
+	struct Sequence {
+		int prev = -1;
+		int runLength = 0;
+		int pairFirst = -1;
+		unsigned handMask = 0;
+		int handSize = 0;
+		uint64_t pos = 0;
+		uint64_t lastSeen[K] = {};			//pos + 1 of each fruit's last appearance, 0 for not yet
+	} seq;
+
+	//start a new, unrelated sequence of outcomes
+	void StartSequence();
+	//count one outcome, 0 <= x < K
+	void Add(int x);
+	//count draws from rnd as one sequence
+	void Feed(RndStream& rnd, uint64_t count);
+	void Merge(const FairnessCounters& other);
+
+private:
+	//Feed keeps the sequence in a local copy so the compiler can hold it in registers
+	void Count(Sequence& s, int x);
+};
+
+struct FairnessResult {
+	std::string test;
+	double statistic;		//chi-square, or z for serial
+	int df;					//degrees of freedom, 0 for a z score
+	double p;				//chance of something at least this extreme from a fair generator
+};
+
+//every test's statistic and p-value
+std::vector<FairnessResult> FairnessResults(const FairnessCounters& counters);
+//a table of results, true if every p is at least alpha
+bool PrintFairness(FILE *pFile, const std::vector<FairnessResult>& results, double alpha);
+//draw numOutcomes across numThreads (0 = all cores) and count them all
+FairnessCounters RunFairness(uint64_t numOutcomes, uint64_t seed, int numThreads = 0);
+
+//upper tail of the chi-square distribution
+double ChiSquareP(double chi2, int df);
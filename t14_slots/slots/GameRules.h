@@ -0,0 +1,18 @@
+#pragma once
+
+#include <vector>
+
+/*
+The constants that decide how much the machine takes and pays out.
+The game and the simulators both use these, so they live on their own.
+*/
+namespace GC {
+	const int NUM_REELS = 5;		//reels in a line
+	const int NUM_FRUIT = 6;		//different fruit on each reel
+	const std::vector<int> CASH_PRIZES = { 15, 20, 30, 50, 100, 250 };	//how much a win is worth for each fruit
+	const int NUDGE_COST = 5;		//cost to nudge
+	const int HOLD_COST = 6;		//cost to hold
+	const int PLAY_COST = 5;		//cost to play
+	const int START_CASH = 200;		//starting pot
+	const int MAX_NUDGEHOLD = 10;	//how many times you can hold and nudge before you have to spin again
+}
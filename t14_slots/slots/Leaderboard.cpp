@@ -0,0 +1,233 @@
+#include <assert.h>
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <queue>
+#include <set>
+#include <thread>
+
+#include "DBPool.h"
+#include "Leaderboard.h"
+#include "MyDB.h"
+#include "Utils.h"
+
+using namespace std;
+
+namespace {
+	//everything read from one cabinet, handed from a worker to the writer
+	struct CabinetChanges {
+		string file;
+		bool ok = false;			//could we read it at all
+		bool restarted = false;		//its SEQ went backwards, the file was replaced so start over
+		long long watermark = 0;	//new watermark once these are applied
+		vector<pair<string, long long>> rows;	//name, score
+	};
+
+	void CreateFloorTables(MyDB& db)
+	{
+		db.ExecQuery("CREATE TABLE IF NOT EXISTS SOURCES(" \
+			"FILE			TEXT	PRIMARY KEY,"\
+			"WATERMARK		INT		NOT NULL)");
+		db.ExecQuery("CREATE TABLE IF NOT EXISTS FLOOR(" \
+			"FILE			TEXT	NOT NULL,"\
+			"NAME			TEXT	NOT NULL,"\
+			"SCORE			INT		NOT NULL,"\
+			"PRIMARY KEY(FILE, NAME)) WITHOUT ROWID");
+		//each cabinet's rows in score order, these are the runs the top K merges
+		db.ExecQuery("CREATE INDEX IF NOT EXISTS FLOOR_RUN ON FLOOR(FILE, SCORE DESC)");
+	}
+
+	//read anything newer than the watermark from one cabinet, runs on a worker thread
+	void ReadCabinet(CabinetChanges& out, long long watermark)
+	{
+		MyDB db;
+		if (!db.OpenFile(out.file, true))
+			return;
+		sqlite3_stmt *pStmt = nullptr;
+		if (sqlite3_prepare_v2(db.pDB, "SELECT IFNULL(MAX(SEQ), 0) FROM HIGHSCORES", -1, &pStmt, nullptr) == SQLITE_OK
+			&& sqlite3_step(pStmt) == SQLITE_ROW) {
+			out.watermark = sqlite3_column_int64(pStmt, 0);
+			out.ok = true;
+		}
+		sqlite3_finalize(pStmt);
+		if (out.ok && out.watermark < watermark) {
+			out.restarted = true;
+			watermark = 0;
+		}
+		if (out.ok && out.watermark > watermark) {
+			//walks the SEQ index, so only the changed rows are touched
+			int rc = sqlite3_prepare_v2(db.pDB, "SELECT NAME, SCORE FROM HIGHSCORES WHERE SEQ > ?1 AND SEQ <= ?2", -1, &pStmt, nullptr);
+			if (rc == SQLITE_OK) {
+				sqlite3_bind_int64(pStmt, 1, watermark);
+				sqlite3_bind_int64(pStmt, 2, out.watermark);
+				while ((rc = sqlite3_step(pStmt)) == SQLITE_ROW)
+					out.rows.emplace_back(reinterpret_cast<const char*>(sqlite3_column_text(pStmt, 0)), sqlite3_column_int64(pStmt, 1));
+			}
+			sqlite3_finalize(pStmt);
+			out.ok = rc == SQLITE_DONE;
+		}
+		db.Close();
+	}
+}
+
+long long UpdateFloor(const string& floorDB, const vector<string>& cabinets, int numThreads)
+{
+	MyDB db;
+	if (!db.OpenFile(floorDB, false))
+		return -1;
+	CreateFloorTables(db);
+
+	//where did we get to last time
+	map<string, long long> watermarks;
+	db.ExecQuery("SELECT FILE, WATERMARK FROM SOURCES");
+	for (size_t i = 0; i < db.results.size(); ++i)
+		watermarks[db.GetStr(i, "FILE").c_str()] = atoll(db.GetStr(i, "WATERMARK").c_str());
+
+	//workers take the next cabinet off the list and queue up what they read for us to write
+	if (numThreads <= 0)
+		numThreads = max(1, (int)thread::hardware_concurrency());
+	numThreads = min(numThreads, max(1, (int)cabinets.size()));
+	atomic<size_t> next(0);
+	mutex lock;
+	condition_variable ready;
+	queue<CabinetChanges*> done;
+	vector<CabinetChanges> changes(cabinets.size());
+	vector<thread> workers;
+	for (int t = 0; t < numThreads; ++t)
+		workers.emplace_back([&]() {
+			for (size_t i = next++; i < cabinets.size(); i = next++) {
+				changes[i].file = cabinets[i];
+				auto it = watermarks.find(cabinets[i]);
+				ReadCabinet(changes[i], it == watermarks.end() ? 0 : it->second);
+				{
+					lock_guard<mutex> guard(lock);
+					done.push(&changes[i]);
+				}
+				ready.notify_one();
+			}
+		});
+
+	//one writer, one transaction
+	MyDB::Query& clear = db.Prepare("DELETE FROM FLOOR WHERE FILE = ?1");
+	MyDB::Query& upsert = db.Prepare("INSERT INTO FLOOR (FILE, NAME, SCORE) VALUES (?1, ?2, ?3) "
+		"ON CONFLICT(FILE, NAME) DO UPDATE SET SCORE = excluded.SCORE");
+	MyDB::Query& mark = db.Prepare("INSERT INTO SOURCES (FILE, WATERMARK) VALUES (?1, ?2) "
+		"ON CONFLICT(FILE) DO UPDATE SET WATERMARK = excluded.WATERMARK");
+	long long numRows = 0;
+	bool ok = db.Begin();
+	for (size_t written = 0; written < cabinets.size(); ++written) {
+		CabinetChanges *pChanges;
+		{
+			unique_lock<mutex> guard(lock);
+			ready.wait(guard, [&]() { return !done.empty(); });
+			pChanges = done.front();
+			done.pop();
+		}
+		if (!pChanges->ok) {
+			DebugPrint("Cannot read cabinet, skipped: ", pChanges->file);
+			continue;
+		}
+		if (ok && pChanges->restarted)
+			ok = db.Exec(clear.Bind(1, pChanges->file));
+		for (size_t i = 0; ok && i < pChanges->rows.size(); ++i)
+			ok = db.Exec(upsert.Bind(1, pChanges->file).Bind(2, pChanges->rows[i].first).Bind(3, pChanges->rows[i].second));
+		ok = ok && db.Exec(mark.Bind(1, pChanges->file).Bind(2, pChanges->watermark));
+		numRows += pChanges->rows.size();
+		//done with it, don't hang on to the memory
+		vector<pair<string, long long>>().swap(pChanges->rows);
+	}
+	for (thread& t : workers)
+		t.join();
+	if (ok)
+		ok = db.Commit();
+	else
+		db.Rollback();
+	db.Close();
+	return ok ? numRows : -1;
+}
+
+//k-way merge on a connection that's already open
+static bool FloorTopK(MyDB& db, int k, vector<LeaderboardEntry>& top)
+{
+	top.clear();
+	//one cursor per cabinet, each already in score order thanks to FLOOR_RUN
+	db.ExecQuery("SELECT FILE FROM SOURCES");
+	vector<string> files;
+	for (size_t i = 0; i < db.results.size(); ++i)
+		files.push_back(db.GetStr(i, "FILE").c_str());
+	vector<sqlite3_stmt*> cursors(files.size(), nullptr);
+	struct Head {
+		long long score;
+		size_t cabinet;
+		string name;
+		bool operator<(const Head& other) const { return score < other.score; }
+	};
+	priority_queue<Head> heads;
+	auto advance = [&](size_t c) {
+		if (sqlite3_step(cursors[c]) == SQLITE_ROW)
+			heads.push(Head{ sqlite3_column_int64(cursors[c], 1), c, reinterpret_cast<const char*>(sqlite3_column_text(cursors[c], 0)) });
+	};
+	bool ok = true;
+	for (size_t c = 0; c < files.size(); ++c) {
+		if (sqlite3_prepare_v2(db.pDB, "SELECT NAME, SCORE FROM FLOOR WHERE FILE = ?1 ORDER BY SCORE DESC", -1, &cursors[c], nullptr) != SQLITE_OK) {
+			ok = false;
+			break;
+		}
+		sqlite3_bind_text(cursors[c], 1, files[c].c_str(), -1, SQLITE_STATIC);
+		advance(c);
+	}
+
+	//always take the highest head, a name we've already taken is a lower score for the same player
+	set<string> seen;
+	while (ok && (int)top.size() < k && !heads.empty()) {
+		Head h = heads.top();
+		heads.pop();
+		if (seen.insert(h.name).second)
+			top.push_back(LeaderboardEntry{ h.name, h.score, files[h.cabinet] });
+		advance(h.cabinet);
+	}
+	for (sqlite3_stmt *pStmt : cursors)
+		sqlite3_finalize(pStmt);
+	return ok;
+}
+
+bool FloorTopK(const string& floorDB, int k, vector<LeaderboardEntry>& top)
+{
+	MyDB db;
+	if (!db.OpenFile(floorDB, true))
+		return false;
+	bool ok = FloorTopK(db, k, top);
+	db.Close();
+	return ok;
+}
+
+bool OpenFloor(DBPool& pool, const string& floorDB, int numReaders)
+{
+	if (!pool.Open(floorDB, numReaders))
+		return false;
+	CreateFloorTables(*pool.Write());
+	return true;
+}
+
+bool FloorTopK(DBPool& pool, int k, vector<LeaderboardEntry>& top)
+{
+	DBPool::Lease db = pool.Read();
+	return FloorTopK(*db, k, top);
+}
+
+bool PostFloorScore(DBPool& pool, const string& cabinet, const string& name, long long score)
+{
+	DBPool::Lease db = pool.Write();
+	//FLOOR mirrors each cabinet's HIGHSCORES, the same as UpdateFloor, so the new score replaces the old one
+	MyDB::Query& upsert = db->Prepare("INSERT INTO FLOOR(FILE, NAME, SCORE) VALUES(?1, ?2, ?3) "
+		"ON CONFLICT(FILE, NAME) DO UPDATE SET SCORE = excluded.SCORE");
+	MyDB::Query& source = db->Prepare("INSERT OR IGNORE INTO SOURCES(FILE, WATERMARK) VALUES(?1, 0)");
+	bool ok = db->Begin()
+		&& db->Exec(source.Bind(1, cabinet))
+		&& db->Exec(upsert.Bind(1, cabinet).Bind(2, name).Bind(3, score));
+	ok = ok && db->Commit();
+	if (!ok)
+		db->Rollback();
+	return ok;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+class DBPool;
+
+/*
+A floor wide leaderboard built from every cabinet's player.db.
+The floor database keeps a copy of each cabinet's HIGHSCORES rows plus a
+watermark per cabinet (the highest SEQ we've seen from it), so updating it
+again only reads rows that changed since last time. Cabinets are read in
+parallel, one sqlite connection per worker thread.
+The top K is a k-way merge of each cabinet's rows in score order: a player
+who plays on several cabinets appears once, with their best score.
+A leaderboard server keeps the floor database open in a DBPool so top K reads
+run on every core while scores are still being posted.
+*/
+struct LeaderboardEntry {
+	std::string name;
+	long long score = 0;
+	std::string cabinet;	//which player.db the score came from
+};
+
+//pull new or changed rows from each cabinet into floorDB, returns how many rows were read or -1
+long long UpdateFloor(const std::string& floorDB, const std::vector<std::string>& cabinets, int numThreads = 0);
+
+//the best k players across every cabinet seen so far
+bool FloorTopK(const std::string& floorDB, int k, std::vector<LeaderboardEntry>& top);
+//open the floor database for a server, one writer and numReaders readers
+bool OpenFloor(DBPool& pool, const std::string& floorDB, int numReaders);
+//the best k on a pooled read-only connection, safe to call from any number of threads
+bool FloorTopK(DBPool& pool, int k, std::vector<LeaderboardEntry>& top);
+//record a player's score on a cabinet as it changes (what its HIGHSCORES row now says), on the pool's writer
+bool PostFloorScore(DBPool& pool, const std::string& cabinet, const std::string& name, long long score);
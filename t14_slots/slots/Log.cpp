@@ -0,0 +1,233 @@
+#include <assert.h>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+#ifdef _WIN32
+#include <Windows.h>
+#endif
+
+#include "Log.h"
+
+using namespace std;
+
+namespace Log
+{
+	namespace {
+		const char *const LEVEL_NAMES[] = { "TRACE", "DEBUG", "INFO ", "WARN ", "ERROR" };
+		const int MAX_LINE = 1024;
+
+		mutex ringsLock;				//only taken when a thread logs for the first time, or by the log thread
+		vector<Ring*> rings;			//every thread that has logged
+		unsigned nextThreadIdx = 0;
+		atomic<unsigned long long> dropped(0);
+
+		thread writer;
+		atomic<bool> running(false);
+		mutex wakeLock;
+		condition_variable wake;
+		mutex drainLock;				//the log thread drains, so does anyone flushing an error
+
+		string fileName;
+		size_t maxBytes = 0;
+		int keepFiles = 0;
+		FILE *pFile = nullptr;
+		size_t fileBytes = 0;
+		const chrono::steady_clock::time_point startTime = chrono::steady_clock::now();
+
+		//lets the log thread know when a thread has gone so it can free the ring
+		struct RingOwner {
+			Ring *pRing = nullptr;
+			~RingOwner() {
+				if (pRing)
+					pRing->retired = true;
+			}
+		};
+		thread_local RingOwner owner;
+
+		Ring& MyRing()
+		{
+			if (!owner.pRing) {
+				Ring *pRing = new Ring;
+				lock_guard<mutex> guard(ringsLock);
+				pRing->threadIdx = nextThreadIdx++;
+				rings.push_back(pRing);
+				owner.pRing = pRing;
+			}
+			return *owner.pRing;
+		}
+
+		//swap the {}s for the arguments
+		size_t Format(const Record& r, unsigned threadIdx, char *pOut, size_t size)
+		{
+			double secs = chrono::duration<double>(chrono::steady_clock::duration(r.ticks)).count();
+			int n = snprintf(pOut, size, "%12.6f T%-2u %s ", secs, threadIdx, LEVEL_NAMES[min((int)r.level, LOG_LEVEL_ERROR)]);
+			size_t len = n > 0 ? (size_t)n : 0;
+			int arg = 0;
+			for (const char *p = r.fmt; *p && len < size - 2; ++p) {
+				if (p[0] != '{' || p[1] != '}' || arg >= r.numArgs) {
+					pOut[len++] = *p;
+					continue;
+				}
+				++p;
+				const Record::Arg& a = r.args[arg];
+				switch (r.types[arg++]) {
+				case Record::INT:	n = snprintf(pOut + len, size - len, "%lld", a.i); break;
+				case Record::UINT:	n = snprintf(pOut + len, size - len, "%llu", a.u); break;
+				case Record::DOUBLE:n = snprintf(pOut + len, size - len, "%g", a.d); break;
+				case Record::CSTR:	n = snprintf(pOut + len, size - len, "%s", a.s ? a.s : "(null)"); break;
+				case Record::TEXT:	n = snprintf(pOut + len, size - len, "%s", r.text + a.text); break;
+				}
+				len = min(len + (n > 0 ? (size_t)n : 0), size - 2);
+			}
+			pOut[len++] = '\n';
+			pOut[len] = 0;
+			return len;
+		}
+
+		void Rotate()
+		{
+			fclose(pFile);
+			char from[512], to[512];
+			for (int i = keepFiles - 1; i >= 1; --i) {
+				snprintf(from, sizeof(from), "%s.%d", fileName.c_str(), i);
+				snprintf(to, sizeof(to), "%s.%d", fileName.c_str(), i + 1);
+				remove(to);
+				rename(from, to);
+			}
+			snprintf(to, sizeof(to), "%s.1", fileName.c_str());
+			remove(to);
+			rename(fileName.c_str(), to);
+			pFile = fopen(fileName.c_str(), "w");
+			fileBytes = 0;
+		}
+
+		//write out everything queued so far
+		void Drain()
+		{
+			lock_guard<mutex> drainGuard(drainLock);
+			static vector<Ring*> snapshot;
+			{
+				lock_guard<mutex> guard(ringsLock);
+				snapshot = rings;
+			}
+			char line[MAX_LINE];
+			for (Ring *pRing : snapshot) {
+				unsigned tail = pRing->tail.load(memory_order_relaxed);
+				unsigned head = pRing->head.load(memory_order_acquire);
+				for (; tail != head; ++tail) {
+					Record& r = pRing->records[tail & (RING_SIZE - 1)];
+					size_t len = Format(r, pRing->threadIdx, line, sizeof(line));
+#ifdef _WIN32
+					OutputDebugString(line);
+#endif
+					if (pFile) {
+						fwrite(line, 1, len, pFile);
+						fileBytes += len;
+						if (maxBytes && fileBytes >= maxBytes)
+							Rotate();
+					}
+				}
+				pRing->tail.store(tail, memory_order_release);
+			}
+			if (pFile)
+				fflush(pFile);
+			//free rings whose threads have finished and been emptied
+			lock_guard<mutex> guard(ringsLock);
+			for (size_t i = 0; i < rings.size();) {
+				Ring *pRing = rings[i];
+				if (pRing->retired && pRing->head.load(memory_order_acquire) == pRing->tail.load(memory_order_relaxed)) {
+					delete pRing;
+					rings[i] = rings.back();
+					rings.pop_back();
+				}
+				else
+					++i;
+			}
+		}
+	}
+
+	void Start(const string& _fileName, size_t _maxBytes, int _keepFiles)
+	{
+		assert(!running);
+		fileName = _fileName;
+		maxBytes = _maxBytes;
+		keepFiles = _keepFiles;
+		pFile = fopen(fileName.c_str(), "a");
+		fileBytes = 0;
+		if (pFile) {
+			fseek(pFile, 0, SEEK_END);
+			fileBytes = (size_t)ftell(pFile);
+		}
+		running = true;
+		writer = thread([]() {
+			while (running) {
+				Drain();
+				unique_lock<mutex> guard(wakeLock);
+				wake.wait_for(guard, chrono::milliseconds(10));
+			}
+		});
+	}
+
+	void Stop()
+	{
+		if (!running)
+			return;
+		running = false;
+		wake.notify_one();
+		writer.join();
+		Drain();
+		if (pFile)
+			fclose(pFile);
+		pFile = nullptr;
+	}
+
+	void Flush()
+	{
+		Drain();
+	}
+
+	unsigned long long Dropped()
+	{
+		return dropped.load(memory_order_relaxed);
+	}
+
+	Record* Begin()
+	{
+		Ring& ring = MyRing();
+		unsigned head = ring.head.load(memory_order_relaxed);
+		if (head - ring.tail.load(memory_order_acquire) >= (unsigned)RING_SIZE) {
+			dropped.fetch_add(1, memory_order_relaxed);
+			return nullptr;
+		}
+		Record& r = ring.records[head & (RING_SIZE - 1)];
+		r.ticks = (chrono::steady_clock::now() - startTime).count();
+		r.numArgs = 0;
+		r.textUsed = 0;
+		return &r;
+	}
+
+	void Commit()
+	{
+		Ring& ring = *owner.pRing;
+		ring.head.store(ring.head.load(memory_order_relaxed) + 1, memory_order_release);
+	}
+
+	void Add(Record& r, const char *v, size_t len)
+	{
+		size_t room = TEXT_BYTES - r.textUsed;
+		if (room == 0) {
+			Add(r, "");		//out of space, show it as empty
+			return;
+		}
+		r.types[r.numArgs] = Record::TEXT;
+		r.args[r.numArgs++].text = r.textUsed;
+		len = min(len, room - 1);
+		memcpy(r.text + r.textUsed, v, len);
+		r.textUsed = (uint8_t)(r.textUsed + len);
+		r.text[r.textUsed++] = 0;
+	}
+}
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+/*
+Asynchronous logger.
+Each thread writes into its own lock-free ring buffer, storing the format
+string and the raw argument values rather than formatted text. A background
+thread drains the rings, does the formatting and writes to a text file,
+rotating it when it gets too big. A full ring drops the message (and counts
+it) rather than making the caller wait, so logging from a frame never blocks.
+Format strings must be string literals, '{}' marks where each argument goes.
+std::string arguments are copied (up to a limit), const char* ones are not so
+they must outlive the call too.
+
+	LOG_INFO("player {} won {}", name, cash);
+
+Anything below LOG_MIN_LEVEL is compiled out altogether. LOG_ERROR is the
+exception to not waiting: it's usually followed by an assert, so the message
+is written out before the call returns rather than left queued for a log
+thread that won't get the chance.
+*/
+#define LOG_LEVEL_TRACE	0
+#define LOG_LEVEL_DEBUG	1
+#define LOG_LEVEL_INFO	2
+#define LOG_LEVEL_WARN	3
+#define LOG_LEVEL_ERROR	4
+
+#ifndef LOG_MIN_LEVEL
+#ifdef _DEBUG
+#define LOG_MIN_LEVEL LOG_LEVEL_DEBUG
+#else
+#define LOG_MIN_LEVEL LOG_LEVEL_INFO
+#endif
+#endif
+
+#define LOG_AT(level, ...) do { if ((level) >= LOG_MIN_LEVEL) Log::Write((level), __VA_ARGS__); } while (0)
+#define LOG_TRACE(...)	LOG_AT(LOG_LEVEL_TRACE, __VA_ARGS__)
+#define LOG_DEBUG(...)	LOG_AT(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#define LOG_INFO(...)	LOG_AT(LOG_LEVEL_INFO, __VA_ARGS__)
+#define LOG_WARN(...)	LOG_AT(LOG_LEVEL_WARN, __VA_ARGS__)
+#define LOG_ERROR(...)	LOG_AT(LOG_LEVEL_ERROR, __VA_ARGS__)
+
+namespace Log
+{
+	const int MAX_ARGS = 8;
+	const int TEXT_BYTES = 96;		//room for copies of std::string arguments
+	const int RING_SIZE = 4096;		//records per thread, must be a power of two
+
+	//one log call, fixed size so it can sit in a ring buffer
+	struct Record {
+		enum ArgType : uint8_t { INT, UINT, DOUBLE, CSTR, TEXT };
+		int64_t ticks;				//when, steady clock
+		const char *fmt;
+		uint8_t level;
+		uint8_t numArgs;
+		uint8_t textUsed;
+		ArgType types[MAX_ARGS];
+		union Arg {
+			long long i;
+			unsigned long long u;
+			double d;
+			const char *s;
+			int text;				//offset into text
+		} args[MAX_ARGS];
+		char text[TEXT_BYTES];
+	};
+
+	//a single producer, single consumer ring, the owning thread writes, the log thread reads
+	struct Ring {
+		Record records[RING_SIZE];
+		std::atomic<unsigned> head{ 0 };	//next slot the owner writes
+		std::atomic<unsigned> tail{ 0 };	//next slot the log thread reads
+		std::atomic<bool> retired{ false };	//the owning thread has gone
+		unsigned threadIdx = 0;
+	};
+
+	//start the background writer, the file is rotated to .1, .2 ... once it reaches maxBytes
+	void Start(const std::string& fileName, size_t maxBytes = 4 * 1024 * 1024, int keepFiles = 3);
+	//write out anything still queued and stop the writer
+	void Stop();
+	//write out everything queued so far, from any thread, before returning
+	void Flush();
+	//how many messages were dropped because a ring was full
+	unsigned long long Dropped();
+
+	//*************************************************
+	//the rest is used by the LOG_ macros
+	Record* Begin();			//null if this thread's ring is full
+	void Commit();
+
+	inline void Add(Record& r, int v) { r.types[r.numArgs] = Record::INT; r.args[r.numArgs++].i = v; }
+	inline void Add(Record& r, long v) { r.types[r.numArgs] = Record::INT; r.args[r.numArgs++].i = v; }
+	inline void Add(Record& r, long long v) { r.types[r.numArgs] = Record::INT; r.args[r.numArgs++].i = v; }
+	inline void Add(Record& r, unsigned v) { r.types[r.numArgs] = Record::UINT; r.args[r.numArgs++].u = v; }
+	inline void Add(Record& r, unsigned long v) { r.types[r.numArgs] = Record::UINT; r.args[r.numArgs++].u = v; }
+	inline void Add(Record& r, unsigned long long v) { r.types[r.numArgs] = Record::UINT; r.args[r.numArgs++].u = v; }
+	inline void Add(Record& r, double v) { r.types[r.numArgs] = Record::DOUBLE; r.args[r.numArgs++].d = v; }
+	inline void Add(Record& r, bool v) { Add(r, (int)v); }
+	inline void Add(Record& r, char v) { Add(r, (int)v); }
+	inline void Add(Record& r, const char *v) { r.types[r.numArgs] = Record::CSTR; r.args[r.numArgs++].s = v; }
+	void Add(Record& r, const char *v, size_t len);	//copied into the record
+	inline void Add(Record& r, const std::string& v) { Add(r, v.c_str(), v.length()); }
+
+	inline void AddArgs(Record&) {}
+	template<class T, class... Rest>
+	void AddArgs(Record& r, const T& v, const Rest&... rest) {
+		Add(r, v);
+		AddArgs(r, rest...);
+	}
+
+	template<class... Args>
+	void Write(int level, const char *fmt, const Args&... args) {
+		static_assert(sizeof...(Args) <= MAX_ARGS, "too many log arguments");
+		//errors never get dropped, empty the ring first so there's room
+		if (level >= LOG_LEVEL_ERROR)
+			Flush();
+		Record *r = Begin();
+		if (!r)
+			return;
+		r->level = (uint8_t)level;
+		r->fmt = fmt;
+		AddArgs(*r, args...);
+		Commit();
+		if (level >= LOG_LEVEL_ERROR)
+			Flush();
+	}
+}
@@ -0,0 +1,48 @@
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "MPMCRing.h"
+
+using namespace std;
+
+bool StressTestMPMCRing(int numPushers, int numPoppers, uint64_t perPusher, size_t capacity)
+{
+	MPMCRing<uint64_t> ring(capacity);
+	const uint64_t total = numPushers * perPusher;
+	//one flag per value, a second pop of the same value or one that was never pushed shows up here
+	unique_ptr<atomic<uint8_t>[]> seen(new atomic<uint8_t>[total]);
+	for (uint64_t i = 0; i < total; ++i)
+		seen[i].store(0, memory_order_relaxed);
+	atomic<uint64_t> popped(0);
+	atomic<bool> bad(false);
+
+	vector<thread> threads;
+	for (int p = 0; p < numPushers; ++p)
+		threads.emplace_back([&, p]() {
+			for (uint64_t i = 0; i < perPusher; ++i)
+				while (!ring.TryPush(p * perPusher + i))
+					this_thread::yield();
+		});
+	for (int c = 0; c < numPoppers; ++c)
+		threads.emplace_back([&]() {
+			uint64_t v;
+			while (popped.load(memory_order_relaxed) < total)
+			{
+				if (!ring.TryPop(v))
+				{
+					this_thread::yield();
+					continue;
+				}
+				if (v >= total || seen[v].exchange(1, memory_order_relaxed) != 0)
+					bad = true;
+				popped.fetch_add(1, memory_order_relaxed);
+			}
+		});
+	for (thread& t : threads)
+		t.join();
+
+	//anything left over was pushed twice
+	uint64_t v;
+	return !bad && !ring.TryPop(v) && popped == total;
+}
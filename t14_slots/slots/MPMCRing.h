@@ -0,0 +1,95 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+/*
+A fixed size queue any number of threads can push to and pop from without
+locks (Dmitry Vyukov's bounded MPMC queue). Every cell has a sequence number
+that says whose turn it is: a pusher claims a position with a compare and
+swap, fills the cell and bumps its number so a popper knows it's ready, and
+the other way round. Push fails when it's full and Pop when it's empty rather
+than waiting, the caller decides what to do about it.
+*/
+template<class T>
+struct MPMCRing
+{
+	struct Cell {
+		std::atomic<size_t> seq;
+		T data;
+	};
+	std::unique_ptr<Cell[]> cells;
+	size_t mask = 0;
+	//pushers and poppers each hammer their own counter, pad them onto separate cache lines
+	//(padding rather than alignas, C++14's new doesn't honour over-alignment)
+	char pad0[64];
+	std::atomic<size_t> pushPos{ 0 };
+	char pad1[64];
+	std::atomic<size_t> popPos{ 0 };
+	char pad2[64];
+
+	//capacity is rounded up to a power of two
+	explicit MPMCRing(size_t capacity) {
+		size_t size = 2;
+		while (size < capacity)
+			size *= 2;
+		cells.reset(new Cell[size]);
+		mask = size - 1;
+		for (size_t i = 0; i < size; ++i)
+			cells[i].seq.store(i, std::memory_order_relaxed);
+	}
+	size_t Capacity() const {
+		return mask + 1;
+	}
+	//roughly how many are waiting, exact when nobody is pushing or popping
+	size_t Size() const {
+		size_t push = pushPos.load(std::memory_order_relaxed);
+		size_t pop = popPos.load(std::memory_order_relaxed);
+		return push > pop ? push - pop : 0;
+	}
+	bool TryPush(const T& value) {
+		size_t pos = pushPos.load(std::memory_order_relaxed);
+		for (;;) {
+			Cell& cell = cells[pos & mask];
+			intptr_t diff = (intptr_t)cell.seq.load(std::memory_order_acquire) - (intptr_t)pos;
+			if (diff == 0) {
+				if (pushPos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+					cell.data = value;
+					cell.seq.store(pos + 1, std::memory_order_release);
+					return true;
+				}
+			}
+			else if (diff < 0)
+				return false;	//full, the cell still holds something from a lap ago
+			else
+				pos = pushPos.load(std::memory_order_relaxed);
+		}
+	}
+	bool TryPop(T& value) {
+		size_t pos = popPos.load(std::memory_order_relaxed);
+		for (;;) {
+			Cell& cell = cells[pos & mask];
+			intptr_t diff = (intptr_t)cell.seq.load(std::memory_order_acquire) - (intptr_t)(pos + 1);
+			if (diff == 0) {
+				if (popPos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+					value = cell.data;
+					cell.seq.store(pos + mask + 1, std::memory_order_release);
+					return true;
+				}
+			}
+			else if (diff < 0)
+				return false;	//empty, nothing has been pushed here yet
+			else
+				pos = popPos.load(std::memory_order_relaxed);
+		}
+	}
+};
+
+/*
+Self check for the ring: numPushers threads push perPusher distinct values
+each through a small ring while numPoppers threads pop them. True if every
+value came out exactly once. slots --ring-test runs it.
+*/
+bool StressTestMPMCRing(int numPushers, int numPoppers, uint64_t perPusher, size_t capacity = 256);
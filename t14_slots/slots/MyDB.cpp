@@ -1,155 +1,424 @@
-#include <assert.h>
-#include <fstream>
-
-#include "MyDB.h"
-#include "Utils.h"
-
-
-using namespace std;
-
-int loadOrSaveDb(sqlite3 *pInMemory, const std::string& zFilename, bool saveToHDD) {
-	int rc;                   /* Function return code */
-	sqlite3 *pFile;           /* Database connection opened on zFilename */
-	sqlite3_backup *pBackup;  /* Backup object used to copy data */
-	sqlite3 *pTo;             /* Database to copy to (pFile or pInMemory) */
-	sqlite3 *pFrom;           /* Database to copy from (pFile or pInMemory) */
-
-	/* Open the database file identified by zFilename. Exit early if this fails
-	** for any reason. */
-	rc = sqlite3_open(zFilename.c_str(), &pFile);
-	if (rc == SQLITE_OK) {
-
-		/* If this is a 'load' operation (isSave==0), then data is copied
-		** from the database file just opened to database pInMemory.
-		** Otherwise, if this is a 'save' operation (isSave==1), then data
-		** is copied from pInMemory to pFile.  Set the variables pFrom and
-		** pTo accordingly. */
-		pFrom = (saveToHDD ? pInMemory : pFile);
-		pTo = (saveToHDD ? pFile : pInMemory);
-
-		/* Set up the backup procedure to copy from the "main" database of
-		** connection pFile to the main database of connection pInMemory.
-		** If something goes wrong, pBackup will be set to NULL and an error
-		** code and message left in connection pTo.
-		**
-		** If the backup object is successfully created, call backup_step()
-		** to copy data from pFile to pInMemory. Then call backup_finish()
-		** to release resources associated with the pBackup object.  If an
-		** error occurred, then an error code and message will be left in
-		** connection pTo. If no error occurred, then the error code belonging
-		** to pTo is set to SQLITE_OK.
-		*/
-		pBackup = sqlite3_backup_init(pTo, "main", pFrom, "main");
-		if (pBackup) {
-			sqlite3_backup_step(pBackup, -1);
-			sqlite3_backup_finish(pBackup);
-		}
-		rc = sqlite3_errcode(pTo);
-	}
-
-	/* Close the database connection opened on database file zFilename
-	** and return the result of this function. */
-	sqlite3_close(pFile);
-	return rc;
-}
-
-static int MyDB_callback(void *pStuff, int argc, char **argv, char **azColName) {
-	assert(pStuff);
-	MyDB *p = reinterpret_cast<MyDB*>(pStuff);
-	return p->Callback(argc, argv, azColName);
-}
-
-
-void MyDB::Init(const std::string & _dbFileName, bool& doesExist) {
-	assert(pDB == nullptr);
-	dbFileName = _dbFileName;
-
-	if (sqlite3_open(":memory:", &pDB)) {
-		DebugPrint("Cannot open DB:", dbFileName);
-		assert(false);
-	}
-	doesExist = false;
-	ifstream f(dbFileName.c_str());
-	if (f.good()) {
-		f.close();
-		int rc = loadOrSaveDb(pDB, dbFileName.c_str(), false);
-		if (rc != SQLITE_OK) {
-			DebugPrint("SQL error: cannot load DB into memory - ", dbFileName);
-			assert(false);
-		}
-		doesExist = true;
-	}
-
-}
-
-bool MyDB::ExecQuery(const string& query)
-{
-	results.clear();
-	char *zErrMsg = 0;
-	int rc = sqlite3_exec(pDB, query.c_str(), MyDB_callback, this, &zErrMsg);
-	return true;
-	if (rc != SQLITE_OK) {
-		DebugPrint("SQL error: ", zErrMsg);
-		sqlite3_free(zErrMsg);
-		assert(false);
-		return false;
-	}
-	return true;
-}
-
-void MyDB::SaveToDisk() 
-{
-	assert(pDB && !dbFileName.empty());
-	int rc = loadOrSaveDb(pDB, dbFileName.c_str(), true);
-	if (rc != SQLITE_OK) {
-		DebugPrint("SQL error: cannot save DB to disk - ", dbFileName);
-		assert(false);
-	}
-}
-
-void MyDB::Close() 
-{
-	sqlite3_close(pDB);
-	pDB = nullptr;
-}
-
-int MyDB::Callback(int argc, char **argv, char **azColName) {
-	Row row;
-	for (int i = 0; i < argc; i++) {
-		row.push_back(Field{ azColName[i], (argv[i] ? argv[i] : "NULL") });
-	}
-	results.push_back(row);
-	return 0;
-}
-
-const string& MyDB::GetStr(int rowNum, const string& fieldName) {
-	Row& r = results.at(rowNum);
-	size_t id = 0;
-	while (id < r.size() && r[id].name != fieldName) {
-		++id;
-	}
-	assert(id < r.size());
-	return r[id].value;
-}
-
-float MyDB::GetFloat(int rowNum, const string& fieldName) {
-	string res = GetStr(rowNum, fieldName);
-	return stof(res);
-}
-int MyDB::GetInt(int rowNum, const string& fieldName) {
-	string res = GetStr(rowNum, fieldName);
-	return stoi(res);
-}
-vector<string> MyDB::GetFieldNames(const string& table) {
-	string sql = "SELECT * FROM " + table;
-	vector<string> fields;
-	sqlite3_stmt *res;
-	int rc = sqlite3_prepare_v2(pDB, sql.c_str(), -1, &res, 0);
-	if (rc == SQLITE_OK)
-	{
-		for (int i = 0; i < sqlite3_column_count(res); ++i)
-			fields.push_back(sqlite3_column_name(res, i));
-	}
-	sqlite3_finalize(res);
-	return fields;
-}
+#include <algorithm>
+#include <assert.h>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+
+#include "Log.h"
+#include "MyDB.h"
+#include "Utils.h"
+
+
+using namespace std;
+
+int loadOrSaveDb(sqlite3 *pInMemory, const std::string& zFilename, bool saveToHDD) {
+	int rc;                   /* Function return code */
+	sqlite3 *pFile;           /* Database connection opened on zFilename */
+	sqlite3_backup *pBackup;  /* Backup object used to copy data */
+	sqlite3 *pTo;             /* Database to copy to (pFile or pInMemory) */
+	sqlite3 *pFrom;           /* Database to copy from (pFile or pInMemory) */
+
+	/* Open the database file identified by zFilename. Exit early if this fails
+	** for any reason. */
+	rc = sqlite3_open(zFilename.c_str(), &pFile);
+	if (rc == SQLITE_OK) {
+
+		/* If this is a 'load' operation (isSave==0), then data is copied
+		** from the database file just opened to database pInMemory.
+		** Otherwise, if this is a 'save' operation (isSave==1), then data
+		** is copied from pInMemory to pFile.  Set the variables pFrom and
+		** pTo accordingly. */
+		pFrom = (saveToHDD ? pInMemory : pFile);
+		pTo = (saveToHDD ? pFile : pInMemory);
+
+		/* Set up the backup procedure to copy from the "main" database of
+		** connection pFile to the main database of connection pInMemory.
+		** If something goes wrong, pBackup will be set to NULL and an error
+		** code and message left in connection pTo.
+		**
+		** If the backup object is successfully created, call backup_step()
+		** to copy data from pFile to pInMemory. Then call backup_finish()
+		** to release resources associated with the pBackup object.  If an
+		** error occurred, then an error code and message will be left in
+		** connection pTo. If no error occurred, then the error code belonging
+		** to pTo is set to SQLITE_OK.
+		*/
+		pBackup = sqlite3_backup_init(pTo, "main", pFrom, "main");
+		if (pBackup) {
+			sqlite3_backup_step(pBackup, -1);
+			sqlite3_backup_finish(pBackup);
+		}
+		rc = sqlite3_errcode(pTo);
+	}
+
+	/* Close the database connection opened on database file zFilename
+	** and return the result of this function. */
+	sqlite3_close(pFile);
+	return rc;
+}
+
+static int MyDB_callback(void *pStuff, int argc, char **argv, char **azColName) {
+	assert(pStuff);
+	MyDB *p = reinterpret_cast<MyDB*>(pStuff);
+	return p->Callback(argc, argv, azColName);
+}
+
+
+void MyDB::Init(const std::string & _dbFileName, bool& doesExist) {
+	assert(pDB == nullptr);
+	dbFileName = _dbFileName;
+
+	if (sqlite3_open(":memory:", &pDB)) {
+		LOG_ERROR("Cannot open DB: {}", dbFileName);
+		assert(false);
+	}
+	doesExist = false;
+	ifstream f(dbFileName.c_str());
+	if (f.good()) {
+		f.close();
+		int rc = loadOrSaveDb(pDB, dbFileName.c_str(), false);
+		if (rc != SQLITE_OK) {
+			LOG_ERROR("SQL error: cannot load DB into memory - {}", dbFileName);
+			assert(false);
+		}
+		doesExist = true;
+	}
+
+}
+
+bool MyDB::OpenFile(const std::string& _dbFileName, bool readOnly) {
+	assert(pDB == nullptr);
+	dbFileName = _dbFileName;
+	onDisk = true;
+	int flags = readOnly ? SQLITE_OPEN_READONLY : (SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE);
+	if (sqlite3_open_v2(dbFileName.c_str(), &pDB, flags, nullptr) != SQLITE_OK) {
+		DebugPrint("Cannot open DB:", dbFileName);
+		sqlite3_close(pDB);
+		pDB = nullptr;
+		return false;
+	}
+	return true;
+}
+
+bool MyDB::OpenShared(const std::string& _dbFileName, bool readOnly, const DBTuning& tuning) {
+	assert(pDB == nullptr);
+	dbFileName = _dbFileName;
+	onDisk = true;
+	//each MyDB is only used by one thread at a time so sqlite can skip its own locking
+	int flags = SQLITE_OPEN_NOMUTEX | (readOnly ? SQLITE_OPEN_READONLY : (SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE));
+	if (sqlite3_open_v2(dbFileName.c_str(), &pDB, flags, nullptr) != SQLITE_OK) {
+		DebugPrint("Cannot open DB:", dbFileName);
+		sqlite3_close(pDB);
+		pDB = nullptr;
+		return false;
+	}
+	sqlite3_busy_timeout(pDB, tuning.busyMs);
+	bool ok = true;
+	if (!readOnly) {
+		//NORMAL is safe with WAL, a power cut can lose the last commits but never corrupts
+		ok = ExecQuery("PRAGMA journal_mode=WAL");
+		if (ok && GetStr(0, "journal_mode") != "wal") {
+			DebugPrint("Cannot switch to WAL:", dbFileName);
+			ok = false;
+		}
+		ok = ok && ExecQuery("PRAGMA synchronous=NORMAL");
+	}
+	ok = ok && ExecQuery("PRAGMA mmap_size=" + to_string(tuning.mmapBytes))
+		&& ExecQuery("PRAGMA cache_size=-" + to_string(tuning.cacheKB));
+	if (!ok) {
+		Close();
+		return false;
+	}
+	return true;
+}
+
+bool MyDB::ExecQuery(const string& query)
+{
+	ClearResults();
+	char *zErrMsg = 0;
+	chrono::steady_clock::time_point start;
+	if (profiling)
+		start = chrono::steady_clock::now();
+	int rc = sqlite3_exec(pDB, query.c_str(), MyDB_callback, this, &zErrMsg);
+	if (profiling) {
+		lastQueryUs = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count();
+		auto it = stats.find(query);
+		if (it == stats.end())
+			it = stats.emplace(query, QueryStats()).first;
+		it->second.Add(lastQueryUs, results.size(), resultBytes, rc == SQLITE_OK);
+	}
+	if (rc != SQLITE_OK) {
+		LOG_ERROR("SQL error: {}", zErrMsg);
+		sqlite3_free(zErrMsg);
+		assert(false);
+		return false;
+	}
+	return true;
+}
+
+MyDB::Query& MyDB::Query::Bind(int idx, int value)
+{
+	assert(pStmt);
+	sqlite3_bind_int(pStmt, idx, value);
+	return *this;
+}
+
+MyDB::Query& MyDB::Query::Bind(int idx, long long value)
+{
+	assert(pStmt);
+	sqlite3_bind_int64(pStmt, idx, value);
+	return *this;
+}
+
+MyDB::Query& MyDB::Query::Bind(int idx, const string& value)
+{
+	assert(pStmt);
+	sqlite3_bind_text(pStmt, idx, value.c_str(), (int)value.length(), SQLITE_TRANSIENT);
+	return *this;
+}
+
+MyDB::Query& MyDB::Prepare(const char *sql)
+{
+	//look it up without building a std::string, this gets called every frame
+	auto it = queries.find(sql);
+	if (it != queries.end())
+		return it->second;
+	Query& q = queries[sql];
+	q.pStats = &stats[sql];
+	if (!q.pStmt) {
+		if (sqlite3_prepare_v2(pDB, sql, -1, &q.pStmt, nullptr) != SQLITE_OK) {
+			LOG_ERROR("SQL error: {}", sqlite3_errmsg(pDB));
+			assert(false);
+		}
+	}
+	return q;
+}
+
+bool MyDB::Exec(Query& query)
+{
+	ClearResults();
+	assert(query.pStmt);
+	const int MAX_COLS = 32;
+	const char *argv[MAX_COLS], *azColName[MAX_COLS];
+	int argc = sqlite3_column_count(query.pStmt);
+	assert(argc <= MAX_COLS);
+	chrono::steady_clock::time_point start;
+	if (profiling)
+		start = chrono::steady_clock::now();
+	int rc;
+	while ((rc = sqlite3_step(query.pStmt)) == SQLITE_ROW) {
+		for (int i = 0; i < argc; ++i) {
+			argv[i] = reinterpret_cast<const char*>(sqlite3_column_text(query.pStmt, i));
+			azColName[i] = sqlite3_column_name(query.pStmt, i);
+		}
+		AddRow(argc, argv, azColName);
+	}
+	if (profiling) {
+		lastQueryUs = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count();
+		query.pStats->Add(lastQueryUs, results.size(), resultBytes, rc == SQLITE_DONE);
+	}
+	if (rc != SQLITE_DONE)
+		LOG_ERROR("SQL error: {}", sqlite3_errmsg(pDB));
+	//ready to be bound and run again
+	sqlite3_reset(query.pStmt);
+	sqlite3_clear_bindings(query.pStmt);
+	if (rc != SQLITE_DONE) {
+		assert(false);
+		return false;
+	}
+	return true;
+}
+
+bool MyDB::Begin()
+{
+	return Exec(Prepare("BEGIN"));
+}
+
+bool MyDB::Commit()
+{
+	return Exec(Prepare("COMMIT"));
+}
+
+void MyDB::Rollback()
+{
+	if (!sqlite3_get_autocommit(pDB))
+		Exec(Prepare("ROLLBACK"));
+}
+
+void MyDB::SaveToDisk() 
+{
+	assert(pDB && !dbFileName.empty());
+	if (onDisk)
+		return;		//already there
+	int rc = loadOrSaveDb(pDB, dbFileName.c_str(), true);
+	if (rc != SQLITE_OK) {
+		LOG_ERROR("SQL error: cannot save DB to disk - {}", dbFileName);
+		assert(false);
+	}
+}
+
+void MyDB::Close() 
+{
+	for (auto& q : queries)
+		sqlite3_finalize(q.second.pStmt);
+	queries.clear();
+	sqlite3_close(pDB);
+	pDB = nullptr;
+}
+
+int MyDB::Callback(int argc, char **argv, char **azColName) {
+	AddRow(argc, argv, azColName);
+	return 0;
+}
+
+void MyDB::ClearResults() {
+	//the old rows are forgotten rather than freed, their memory goes back with the arena
+	results = std::vector<Row, ArenaAllocator<Row>>(ArenaAllocator<Row>(arena));
+	arena.Reset();
+	resultBytes = 0;
+}
+
+void MyDB::AddRow(int argc, const char *const *argv, const char *const *azColName) {
+	ArenaAllocator<char> alloc(arena);
+	Row row(alloc);
+	row.reserve(argc);
+	for (int i = 0; i < argc; i++) {
+		row.push_back(Field{ ArenaString(azColName[i], alloc), ArenaString(argv[i] ? argv[i] : "NULL", alloc) });
+		resultBytes += row.back().value.length();
+	}
+	results.push_back(std::move(row));
+}
+
+const ArenaString& MyDB::GetStr(int rowNum, const char *fieldName) {
+	Row& r = results.at(rowNum);
+	size_t id = 0;
+	while (id < r.size() && r[id].name != fieldName) {
+		++id;
+	}
+	assert(id < r.size());
+	return r[id].value;
+}
+
+float MyDB::GetFloat(int rowNum, const char *fieldName) {
+	return strtof(GetStr(rowNum, fieldName).c_str(), nullptr);
+}
+int MyDB::GetInt(int rowNum, const char *fieldName) {
+	return atoi(GetStr(rowNum, fieldName).c_str());
+}
+vector<string> MyDB::GetFieldNames(const string& table) {
+	string sql = "SELECT * FROM " + table;
+	vector<string> fields;
+	sqlite3_stmt *res;
+	int rc = sqlite3_prepare_v2(pDB, sql.c_str(), -1, &res, 0);
+	if (rc == SQLITE_OK)
+	{
+		for (int i = 0; i < sqlite3_column_count(res); ++i)
+			fields.push_back(sqlite3_column_name(res, i));
+	}
+	sqlite3_finalize(res);
+	return fields;
+}
+
+void CreatePlayerTables(MyDB& db)
+{
+	db.ExecQuery("CREATE TABLE IF NOT EXISTS HIGHSCORES(" \
+		"ID				 INTEGER PRIMARY KEY autoincrement,"\
+		"NAME			TEXT	NOT NULL,"\
+		"SCORE			INT		NOT NULL,"\
+		"SEQ			INT		NOT NULL DEFAULT 0)");
+	db.ExecQuery("CREATE TABLE IF NOT EXISTS PLAYS(" \
+		"ID				INTEGER PRIMARY KEY autoincrement,"\
+		"HIGHSCORE_ID	INT		NOT NULL,"\
+		"TOTAL_PLAYS	INT		NOT NULL,"\
+		"TOTAL_NUDGES	INT		NOT NULL)");
+	db.ExecQuery("SELECT NAME FROM sqlite_master WHERE type='index' AND name='HIGHSCORES_NAME'");
+	if (db.results.empty())
+	{
+		//one row per player from now on, keep the newest if there are duplicates
+		db.ExecQuery("DELETE FROM HIGHSCORES WHERE ID NOT IN (SELECT MAX(ID) FROM HIGHSCORES GROUP BY NAME)");
+		db.ExecQuery("DELETE FROM PLAYS WHERE ID NOT IN (SELECT MAX(ID) FROM PLAYS GROUP BY HIGHSCORE_ID)");
+	}
+	//SEQ goes up every time a row changes so other tools can pick up just the new bits,
+	//files from before it existed count every row as new
+	db.ExecQuery("SELECT name FROM pragma_table_info('HIGHSCORES') WHERE name='SEQ'");
+	if (db.results.empty())
+	{
+		db.ExecQuery("ALTER TABLE HIGHSCORES ADD COLUMN SEQ INT NOT NULL DEFAULT 0");
+		db.ExecQuery("UPDATE HIGHSCORES SET SEQ = ID");
+	}
+	db.ExecQuery("CREATE INDEX IF NOT EXISTS HIGHSCORES_SEQ ON HIGHSCORES(SEQ)");
+	//find a player by name and the lowest/highest scores without scanning the table
+	db.ExecQuery("CREATE UNIQUE INDEX IF NOT EXISTS HIGHSCORES_NAME ON HIGHSCORES(NAME)");
+	db.ExecQuery("CREATE INDEX IF NOT EXISTS HIGHSCORES_SCORE ON HIGHSCORES(SCORE)");
+	db.ExecQuery("CREATE UNIQUE INDEX IF NOT EXISTS PLAYS_HIGHSCORE_ID ON PLAYS(HIGHSCORE_ID)");
+	//a player dropped off the bottom takes their play stats with them
+	db.ExecQuery("CREATE TRIGGER IF NOT EXISTS HIGHSCORES_DELETE AFTER DELETE ON HIGHSCORES "\
+		"BEGIN DELETE FROM PLAYS WHERE HIGHSCORE_ID = OLD.ID; END");
+}
+
+//*************************************************
+//profiling
+
+void MyDB::QueryStats::Add(double us, size_t numRows, size_t numBytes, bool ok)
+{
+	++calls;
+	if (!ok)
+		++failures;
+	rows += numRows;
+	bytes += numBytes;
+	totalUs += us;
+	maxUs = max(maxUs, us);
+	int idx = (int)(log2(us + 1.0) * 4.0);
+	++buckets[min(idx, NUM_BUCKETS - 1)];
+}
+
+double MyDB::QueryStats::Percentile(double fraction) const
+{
+	unsigned target = (unsigned)ceil(calls * fraction), seen = 0;
+	for (int i = 0; i < NUM_BUCKETS; ++i) {
+		seen += buckets[i];
+		if (seen >= target && seen > 0 && i == NUM_BUCKETS - 1)
+			return maxUs;		//overflow, it has no top edge
+		if (seen >= target && seen > 0)
+			return min(maxUs, pow(2.0, (i + 1) / 4.0) - 1.0);	//top edge of the bucket
+	}
+	return maxUs;
+}
+
+const MyDB::QueryStats* MyDB::GetStats(const string& sql) const
+{
+	auto it = stats.find(sql);
+	if (it == stats.end() || it->second.calls == 0)
+		return nullptr;
+	return &it->second;
+}
+
+void MyDB::ResetStats()
+{
+	//keep the entries, prepared queries point at them
+	for (auto& s : stats)
+		s.second = QueryStats();
+}
+
+bool MyDB::DumpStats(const string& fileName) const
+{
+	ofstream f(fileName.c_str());
+	if (!f.good()) {
+		DebugPrint("Cannot write query stats: ", fileName);
+		return false;
+	}
+	vector<const pair<const string, QueryStats>*> order;
+	for (auto& s : stats)
+		if (s.second.calls)
+			order.push_back(&s);
+	sort(order.begin(), order.end(), [](auto a, auto b) { return a->second.totalUs > b->second.totalUs; });
+	f << "calls\tfailed\ttotal_us\tp50_us\tp99_us\tmax_us\trows\tbytes\tsql\n";
+	for (auto p : order) {
+		const QueryStats& qs = p->second;
+		f << qs.calls << '\t' << qs.failures << '\t' << qs.totalUs << '\t'
+			<< qs.Percentile(0.5) << '\t' << qs.Percentile(0.99) << '\t' << qs.maxUs << '\t'
+			<< qs.rows << '\t' << qs.bytes << '\t' << p->first << '\n';
+	}
+	return true;
+}
@@ -1,63 +1,137 @@
-#pragma once
-
-#include <string>
-#include <vector>
-
-#include "..\..\sqlite\sqlite3.h"
-
-/*
-** This function is used to load the contents of a database file on disk
-** into the "main" database of open database connection pInMemory, or
-** to save the current contents of the database opened by pInMemory into
-** a database file on disk. pInMemory is probably an in-memory database,
-** but this function will also work fine if it is not.
-**
-** Parameter zFilename points to a nul-terminated string containing the
-** name of the database file on disk to load from or save to. If parameter
-** isSave is non-zero, then the contents of the file zFilename are
-** overwritten with the contents of the database opened by pInMemory. If
-** parameter isSave is zero, then the contents of the database opened by
-** pInMemory are replaced by data loaded from the file zFilename.
-**
-** If the operation is successful, SQLITE_OK is returned. Otherwise, if
-** an error occurs, an SQLite error code is returned.
-*/
-int loadOrSaveDb(sqlite3 *pInMemory, const std::string& zFilename, bool saveToHDD);
-
-/*
-Wrap the sqlite3 interface, give a more OOP flavour and
-simplify its use.
-*/
-struct MyDB {
-	sqlite3 *pDB = nullptr;	//main handle to database
-	struct Field {
-		std::string name;	//field name
-		std::string value;	//field value - we don't know what type it is
-	};
-	typedef std::vector<Field> Row;	//one row of results
-	std::vector<Row> results;		//all the rows returned from the last query
-	std::string dbFileName;		//location of the database on HDD		
-
-	//open the database, if it doesn't exist then make it
-	void Init(const std::string& _dbFileName, bool& doesExist);
-	//save the database to HDD
-	void SaveToDisk();
-	//called when we finish using the database
-	void Close();
-	//send an SQL query to the database
-	bool ExecQuery(const std::string& query);
-
-	//convert a particular row+field string to the target type
-	const std::string& GetStr(int rowNum, const std::string& fieldName);
-	float GetFloat(int rowNum, const std::string& fieldName);
-	int GetInt(int rowNum, const std::string& fieldName);
-	
-	//get all the field names in a specific table
-	std::vector<std::string> GetFieldNames(const std::string& table);
-	//the callback is used to get results back from the database
-	int Callback(int argc, char **argv, char **azColName);
-};
-
-
-
-
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "..\..\sqlite\sqlite3.h"
+#include "Arena.h"
+
+/*
+** This function is used to load the contents of a database file on disk
+** into the "main" database of open database connection pInMemory, or
+** to save the current contents of the database opened by pInMemory into
+** a database file on disk. pInMemory is probably an in-memory database,
+** but this function will also work fine if it is not.
+**
+** Parameter zFilename points to a nul-terminated string containing the
+** name of the database file on disk to load from or save to. If parameter
+** isSave is non-zero, then the contents of the file zFilename are
+** overwritten with the contents of the database opened by pInMemory. If
+** parameter isSave is zero, then the contents of the database opened by
+** pInMemory are replaced by data loaded from the file zFilename.
+**
+** If the operation is successful, SQLITE_OK is returned. Otherwise, if
+** an error occurs, an SQLite error code is returned.
+*/
+int loadOrSaveDb(sqlite3 *pInMemory, const std::string& zFilename, bool saveToHDD);
+
+/*
+How a file backed connection is set up when several threads share a database.
+WAL lets readers carry on while the writer commits, reads come straight out of
+the memory mapped file instead of being copied through sqlite's page cache.
+*/
+struct DBTuning {
+	long long mmapBytes = 256ll << 20;	//how much of the file to memory map
+	int cacheKB = 16 << 10;				//page cache per connection
+	int busyMs = 5000;					//how long to wait on a lock before giving up
+};
+
+/*
+Wrap the sqlite3 interface, give a more OOP flavour and
+simplify its use.
+*/
+struct MyDB {
+	sqlite3 *pDB = nullptr;	//main handle to database
+	Arena arena;			//results live in here until the next query, so reading rows doesn't hit the heap
+	struct Field {
+		ArenaString name;	//field name
+		ArenaString value;	//field value - we don't know what type it is
+	};
+	typedef std::vector<Field, ArenaAllocator<Field>> Row;	//one row of results
+	std::vector<Row, ArenaAllocator<Row>> results{ ArenaAllocator<Row>(arena) };	//all the rows returned from the last query
+	std::string dbFileName;		//location of the database on HDD		
+	bool onDisk = false;		//working straight on the file rather than an in memory copy
+	size_t resultBytes = 0;		//how much text the last query returned
+
+	/*
+	What each distinct statement has cost us since profiling was switched on.
+	Latencies go into a log scale histogram, four buckets per doubling of
+	microseconds, so percentiles are accurate to about 20%. That reaches past an
+	hour, anything slower lands in the last bucket which reports the worst call.
+	*/
+	struct QueryStats {
+		static const int NUM_BUCKETS = 128;
+		unsigned calls = 0;				//how many times it ran
+		unsigned failures = 0;			//how many times sqlite said no
+		unsigned long long rows = 0;	//total rows returned
+		unsigned long long bytes = 0;	//total text materialised into results
+		double totalUs = 0;				//total time spent in sqlite
+		double maxUs = 0;				//the worst one
+		unsigned buckets[NUM_BUCKETS] = {};
+
+		void Add(double us, size_t numRows, size_t numBytes, bool ok);
+		//roughly how long the slowest 'fraction' of calls take, e.g. 0.99 for p99
+		double Percentile(double fraction) const;
+	};
+	bool profiling = false;		//off means the only cost is checking this flag
+	std::map<std::string, QueryStats, std::less<>> stats;	//keyed on the SQL text
+	double lastQueryUs = 0;		//how long the most recent query took, if profiling
+
+	//a compiled query with '?' placeholders, bind the values then run it with Exec
+	struct Query {
+		sqlite3_stmt *pStmt = nullptr;
+		QueryStats *pStats = nullptr;	//where this query's timings go
+		Query& Bind(int idx, int value);
+		Query& Bind(int idx, long long value);
+		Query& Bind(int idx, const std::string& value);
+	};
+	std::map<std::string, Query, std::less<>> queries;	//compiled once, reused every time the same SQL is run
+
+	//open the database, if it doesn't exist then make it
+	void Init(const std::string& _dbFileName, bool& doesExist);
+	//work directly on a database file without loading it all into memory, false if it can't be opened
+	bool OpenFile(const std::string& _dbFileName, bool readOnly);
+	//work on a database file in WAL mode that other connections are using at the same time,
+	//the first writer turns WAL on and it stays on in the file
+	bool OpenShared(const std::string& _dbFileName, bool readOnly, const DBTuning& tuning = DBTuning());
+	//save the database to HDD
+	void SaveToDisk();
+	//called when we finish using the database
+	void Close();
+	//send an SQL query to the database
+	bool ExecQuery(const std::string& query);
+	//compile a query (or find the one we compiled last time) ready to bind values to
+	Query& Prepare(const char *sql);
+	//run a prepared query, any rows end up in results just like ExecQuery
+	bool Exec(Query& query);
+	//group several queries so they all happen or none do
+	bool Begin();
+	bool Commit();
+	void Rollback();
+
+	//convert a particular row+field string to the target type
+	const ArenaString& GetStr(int rowNum, const char *fieldName);
+	float GetFloat(int rowNum, const char *fieldName);
+	int GetInt(int rowNum, const char *fieldName);
+	
+	//get all the field names in a specific table
+	std::vector<std::string> GetFieldNames(const std::string& table);
+	//the callback is used to get results back from the database
+	int Callback(int argc, char **argv, char **azColName);
+	//look up how a statement has been doing, null if it hasn't run while profiling
+	const QueryStats* GetStats(const std::string& sql) const;
+	//forget all the timings so far
+	void ResetStats();
+	//write a table of every statement's costs, slowest total first
+	bool DumpStats(const std::string& fileName) const;
+	//throw away the last results and recycle the memory they used
+	void ClearResults();
+	//add a row to the results
+	void AddRow(int argc, const char *const *argv, const char *const *azColName);
+};
+
+//make sure the tables (and indices) the slot machine keeps its players in are there
+void CreatePlayerTables(MyDB& db);
+//use this as the SEQ value whenever a HIGHSCORES row is inserted or updated
+#define NEXT_HIGHSCORE_SEQ "(SELECT IFNULL(MAX(SEQ), 0) + 1 FROM HIGHSCORES)"
@@ -0,0 +1,102 @@
+#include <algorithm>
+#include <assert.h>
+#include <ctime>
+
+#include "OutcomePool.h"
+#include "Parallel.h"
+
+using namespace std;
+
+SpinOutcome OutcomePool::Roll(RndStream& rnd, const Paytable& table)
+{
+	SpinOutcome out;
+	bool line = true;
+	for (int i = 0; i < GC::NUM_REELS; ++i) {
+		out.fruit[i] = (int8_t)rnd.GetRange(0, GC::NUM_FRUIT - 1);
+		line = line && out.fruit[i] == out.fruit[0];
+	}
+	out.lineFruit = line ? out.fruit[0] : -1;
+	out.prize = line ? table.prizes[out.fruit[0]] : 0;
+	return out;
+}
+
+void OutcomePool::Start(int numProducers, uint64_t seed)
+{
+	assert(!running);
+	if (numProducers <= 0)
+		numProducers = max(1, NumWorkers(0) - 1);
+	if (seed == 0)
+		seed = (uint64_t)time(nullptr) ^ ((uint64_t)clock() << 32);
+	lowWater = ring.Capacity();
+	running = true;
+	for (int i = 0; i < numProducers; ++i)
+		producers.emplace_back(&OutcomePool::Produce, this, BlockSeed(seed, i));
+}
+
+void OutcomePool::Stop()
+{
+	{
+		lock_guard<mutex> guard(parkLock);
+		running = false;
+	}
+	refill.notify_all();
+	for (thread& t : producers)
+		t.join();
+	producers.clear();
+}
+
+void OutcomePool::Produce(uint64_t seed)
+{
+	RndStream rnd(seed);
+	SpinOutcome next = Roll(rnd, table);
+	while (running) {
+		if (ring.TryPush(next)) {
+			produced.fetch_add(1, memory_order_relaxed);
+			next = Roll(rnd, table);
+		}
+		else {
+			//full, sleep until Take has used up half of it rather than polling
+			stalls.fetch_add(1, memory_order_relaxed);
+			unique_lock<mutex> guard(parkLock);
+			//counted before looking at the size, Take looks at the size before the count, so one of us sees the other
+			parked.fetch_add(1);
+			refill.wait(guard, [this]() { return !running || ring.Size() < RefillMark(); });
+			parked.fetch_sub(1);
+		}
+	}
+}
+
+SpinOutcome OutcomePool::Take(RndStream& rnd)
+{
+	taken.fetch_add(1, memory_order_relaxed);
+	SpinOutcome out;
+	if (!ring.TryPop(out)) {
+		misses.fetch_add(1, memory_order_relaxed);
+		out = Roll(rnd, table);
+	}
+	size_t depth = ring.Size();
+	if (depth < RefillMark()) {
+		atomic_thread_fence(memory_order_seq_cst);
+		if (parked.load(memory_order_relaxed) > 0) {
+			lock_guard<mutex> guard(parkLock);
+			refill.notify_all();
+		}
+	}
+	size_t low = lowWater.load(memory_order_relaxed);
+	while (depth < low && !lowWater.compare_exchange_weak(low, depth, memory_order_relaxed))
+		;
+	return out;
+}
+
+OutcomePool::Stats OutcomePool::GetStats() const
+{
+	Stats stats;
+	stats.produced = produced.load(memory_order_relaxed);
+	stats.taken = taken.load(memory_order_relaxed);
+	stats.misses = misses.load(memory_order_relaxed);
+	stats.stalls = stalls.load(memory_order_relaxed);
+	stats.depth = ring.Size();
+	stats.lowWater = lowWater.load(memory_order_relaxed);
+	stats.capacity = ring.Capacity();
+	return stats;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "GameRules.h"
+#include "MPMCRing.h"
+#include "Sim.h"
+#include "Utils.h"
+
+//one spin, rolled and scored ahead of time
+struct SpinOutcome {
+	int8_t fruit[GC::NUM_REELS];
+	int8_t lineFruit;		//the fruit that made a line, -1 for a loss
+	int32_t prize;			//what it pays, 0 for a loss
+};
+
+/*
+Spins rolled and scored by background threads ahead of time so taking one is
+a constant time pop from a lock-free ring, however costly rolling and scoring
+gets. Producers park when the ring is full (backpressure) and Take wakes them
+once it's been drained below half, so an idle pool costs nothing. If a burst
+empties it a spin is rolled on the spot instead and counted as a miss, so the
+ring's depth and misses say whether there are enough producers.
+Every outcome comes from its own uniform draws so the order they're used in
+makes no difference to the odds.
+*/
+struct OutcomePool
+{
+	//how the pool is coping, all counts since Start
+	struct Stats {
+		uint64_t produced = 0;
+		uint64_t taken = 0;
+		uint64_t misses = 0;		//taken when empty, rolled on the spot
+		uint64_t stalls = 0;		//a producer found it full and parked until it drained
+		size_t depth = 0;			//ready right now
+		size_t lowWater = 0;		//the emptiest it's been
+		size_t capacity = 0;
+	};
+
+	explicit OutcomePool(size_t capacity, const Paytable& table = Paytable()) : ring(capacity), table(table) {}
+	~OutcomePool() { Stop(); }
+	//start numProducers threads (0 = all cores less one) filling the pool
+	void Start(int numProducers = 0, uint64_t seed = 0);
+	void Stop();
+	//the next outcome, rolled with rnd if the pool has run dry
+	SpinOutcome Take(RndStream& rnd);
+	Stats GetStats() const;
+	//roll and score one spin
+	static SpinOutcome Roll(RndStream& rnd, const Paytable& table);
+
+private:
+	void Produce(uint64_t seed);
+	size_t RefillMark() const { return ring.Capacity() / 2; }
+
+	MPMCRing<SpinOutcome> ring;
+	Paytable table;
+	std::vector<std::thread> producers;
+	std::atomic<bool> running{ false };
+	std::mutex parkLock;
+	std::condition_variable refill;		//producers wait on this while the ring is full
+	std::atomic<int> parked{ 0 };		//how many are waiting, so Take only signals when someone is
+	std::atomic<uint64_t> produced{ 0 };
+	std::atomic<uint64_t> taken{ 0 };
+	std::atomic<uint64_t> misses{ 0 };
+	std::atomic<uint64_t> stalls{ 0 };
+	std::atomic<size_t> lowWater{ 0 };
+};
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "Utils.h"
+
+//the seed for one block's random stream
+inline uint64_t BlockSeed(uint64_t seed, uint64_t block)
+{
+	//mix the block number in so neighbouring blocks aren't related
+	return RndStream(seed ^ (block * 0xd1b54a32d192ed03ull)).Next();
+}
+
+//how many threads to use, 0 means one per core
+inline int NumWorkers(int numThreads)
+{
+	return numThreads > 0 ? numThreads : (int)std::max(1u, std::thread::hardware_concurrency());
+}
+
+/*
+Run blocks [firstBlock, endBlock) of numItems split into fixed size blocks,
+across numThreads (0 = all cores). work(threadIdx, rnd, first, end) gets a
+random stream made from the seed and block number, so the numbers each item
+sees don't depend on which thread ran it, how many threads there were or how
+the blocks were split between runs. Returns how many threads were used.
+*/
+template <typename Work>
+int RunBlockRange(uint64_t numItems, uint64_t blockSize, uint64_t firstBlock, uint64_t endBlock, uint64_t seed, int numThreads, Work work)
+{
+	endBlock = std::min(endBlock, (numItems + blockSize - 1) / blockSize);
+	const uint64_t numBlocks = endBlock > firstBlock ? endBlock - firstBlock : 0;
+	numThreads = (int)std::min<uint64_t>(NumWorkers(numThreads), std::max<uint64_t>(numBlocks, 1));
+
+	std::atomic<uint64_t> nextBlock(firstBlock);
+	auto run = [&](int idx) {
+		for (uint64_t b = nextBlock++; b < endBlock; b = nextBlock++)
+		{
+			RndStream rnd(BlockSeed(seed, b));
+			work(idx, rnd, b * blockSize, std::min(numItems, (b + 1) * blockSize));
+		}
+	};
+	std::vector<std::thread> threads;
+	for (int i = 1; i < numThreads; ++i)
+		threads.emplace_back(run, i);
+	run(0);
+	for (std::thread& t : threads)
+		t.join();
+	return numThreads;
+}
+
+//all of numItems, see RunBlockRange
+template <typename Work>
+int RunBlocks(uint64_t numItems, uint64_t blockSize, uint64_t seed, int numThreads, Work work)
+{
+	return RunBlockRange(numItems, blockSize, 0, (numItems + blockSize - 1) / blockSize, seed, numThreads, work);
+}
@@ -0,0 +1,513 @@
+#include <assert.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#ifdef _WIN32
+#include <Windows.h>
+#include <direct.h>
+#include <io.h>
+#else
+#include <spawn.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include "Shard.h"
+
+using namespace std;
+
+#ifndef _WIN32
+extern char **environ;
+#endif
+
+namespace {
+	const uint32_t SHARD_MAGIC = 0x44524853;	//"SHRD"
+	const uint32_t SHARD_VERSION = 1;
+	const char *PLAN_FILE = "run.plan";
+
+	/*
+	Shard files are written byte by byte little endian so machines of any sort
+	can share them. Sketches are mostly empty buckets so only the used ones go in.
+	*/
+	struct Writer {
+		vector<unsigned char> bytes;
+
+		void Put(uint64_t x, int size = 8)
+		{
+			for (int i = 0; i < size; ++i)
+				bytes.push_back((unsigned char)(x >> (i * 8)));
+		}
+	};
+
+	struct Reader {
+		const unsigned char *p;
+		const unsigned char *pEnd;
+		bool ok = true;
+
+		uint64_t Get(int size = 8)
+		{
+			if (pEnd - p < size)
+			{
+				ok = false;
+				return 0;
+			}
+			uint64_t x = 0;
+			for (int i = 0; i < size; ++i)
+				x |= (uint64_t)*p++ << (i * 8);
+			return x;
+		}
+	};
+
+	//FNV-1a, 64 bits as shard files get passed around a lot
+	uint64_t Checksum(const unsigned char *p, size_t size)
+	{
+		uint64_t h = 14695981039346656037ull;
+		for (size_t i = 0; i < size; ++i)
+			h = (h ^ p[i]) * 1099511628211ull;
+		return h;
+	}
+
+	void PutPlan(Writer& w, const ShardPlan& plan)
+	{
+		for (int i = 0; i < GC::NUM_FRUIT; ++i)
+			w.Put((uint32_t)plan.table.prizes[i], 4);
+		w.Put((uint32_t)plan.table.playCost, 4);
+		w.Put((uint32_t)plan.table.nudgeCost, 4);
+		w.Put((uint32_t)plan.table.holdCost, 4);
+		w.Put((uint32_t)plan.table.maxNudgeHold, 4);
+		w.Put((uint32_t)plan.table.startCash, 4);
+		w.Put((uint32_t)plan.policy, 4);
+		w.Put((uint32_t)plan.maxSpins, 4);
+		w.Put(plan.sessions);
+		w.Put(plan.seed);
+		w.Put(plan.numShards, 4);
+	}
+
+	void GetPlan(Reader& r, ShardPlan& plan)
+	{
+		for (int i = 0; i < GC::NUM_FRUIT; ++i)
+			plan.table.prizes[i] = (int)r.Get(4);
+		plan.table.playCost = (int)r.Get(4);
+		plan.table.nudgeCost = (int)r.Get(4);
+		plan.table.holdCost = (int)r.Get(4);
+		plan.table.maxNudgeHold = (int)r.Get(4);
+		plan.table.startCash = (int)r.Get(4);
+		plan.policy = (Policy)r.Get(4);
+		plan.maxSpins = (int)r.Get(4);
+		plan.sessions = r.Get();
+		plan.seed = r.Get();
+		plan.numShards = (uint32_t)r.Get(4);
+	}
+
+	void PutTotals(Writer& w, const IntTotals& t)
+	{
+		w.Put(t.n);
+		w.Put(t.sum);
+		w.Put(t.sqLo);
+		w.Put(t.sqHi);
+		w.Put(t.min);
+		w.Put(t.max);
+	}
+
+	void GetTotals(Reader& r, IntTotals& t)
+	{
+		t.n = r.Get();
+		t.sum = r.Get();
+		t.sqLo = r.Get();
+		t.sqHi = r.Get();
+		t.min = r.Get();
+		t.max = r.Get();
+	}
+
+	void PutSketch(Writer& w, const QuantileSketch& sk)
+	{
+		w.Put(sk.low);
+		w.Put(sk.total);
+		uint32_t used = (uint32_t)count_if(sk.buckets, sk.buckets + QuantileSketch::NUM_BUCKETS, [](uint64_t c) { return c != 0; });
+		w.Put(used, 4);
+		for (int i = 0; i < QuantileSketch::NUM_BUCKETS; ++i)
+			if (sk.buckets[i])
+			{
+				w.Put((uint32_t)i, 2);
+				w.Put(sk.buckets[i]);
+			}
+	}
+
+	void GetSketch(Reader& r, QuantileSketch& sk)
+	{
+		sk.low = r.Get();
+		sk.total = r.Get();
+		uint32_t used = (uint32_t)r.Get(4);
+		for (uint32_t i = 0; i < used && r.ok; ++i)
+		{
+			int idx = (int)r.Get(2);
+			uint64_t c = r.Get();
+			if (idx >= QuantileSketch::NUM_BUCKETS)
+				r.ok = false;
+			else
+				sk.buckets[idx] = c;
+		}
+	}
+
+	bool IsFinished(const string& dir, const ShardPlan& plan, uint32_t shard)
+	{
+		ShardPlan filePlan;
+		uint32_t fileShard = 0;
+		SessionStats stats;
+		return LoadShard(ShardFileName(dir, shard), filePlan, fileShard, stats) && filePlan == plan && fileShard == shard;
+	}
+
+	//unique to this process on this machine, two workers on a reclaimed shard mustn't share a temp file
+	string TempName(const string& fileName)
+	{
+		char host[256] = "host";
+#ifdef _WIN32
+		DWORD size = sizeof(host);
+		GetComputerNameA(host, &size);
+		unsigned long pid = GetCurrentProcessId();
+#else
+		gethostname(host, sizeof(host) - 1);
+		unsigned long pid = (unsigned long)getpid();
+#endif
+		return fileName + "." + host + "." + to_string(pid) + ".tmp";
+	}
+
+	//make sure it's on the disk, not just handed to the OS, before it's renamed into place
+	bool SyncFile(FILE *pFile)
+	{
+		if (fflush(pFile) != 0)
+			return false;
+#ifdef _WIN32
+		return _commit(_fileno(pFile)) == 0;
+#else
+		return fsync(fileno(pFile)) == 0;
+#endif
+	}
+
+	//exclusive create, works across machines on any sensible shared filesystem
+	bool Claim(const string& claimName, bool reclaim)
+	{
+		FILE *pFile = fopen(claimName.c_str(), "wx");
+		if (!pFile && reclaim)
+			pFile = fopen(claimName.c_str(), "w");
+		if (!pFile)
+			return false;
+		fclose(pFile);
+		return true;
+	}
+
+	//the plan is a text file so it can be read, and made by hand for a cluster if need be
+#define PLAN_FORMAT(POLICY) \
+		"slots shard plan %u\n" \
+		"policy " POLICY "\n" \
+		"max spins %d\n" \
+		"sessions %llu\n" \
+		"seed %llu\n" \
+		"shards %u\n" \
+		"prizes %d %d %d %d %d %d\n" \
+		"play nudge hold %d %d %d\n" \
+		"max nudge hold %d\n" \
+		"start cash %d\n"
+	static_assert(GC::NUM_FRUIT == 6, "PLAN_FORMAT has a prize per fruit");
+}
+
+void ShardPlan::ShardBlocks(uint32_t shard, uint64_t& firstBlock, uint64_t& endBlock) const
+{
+	assert(shard < numShards);
+	//blocks rather than sessions so the streams line up with an unsharded run
+	uint64_t numBlocks = (sessions + SESSION_BLOCK - 1) / SESSION_BLOCK;
+	firstBlock = numBlocks * shard / numShards;
+	endBlock = numBlocks * (shard + 1) / numShards;
+}
+
+bool ShardPlan::operator==(const ShardPlan& other) const
+{
+	Writer a, b;
+	PutPlan(a, *this);
+	PutPlan(b, other);
+	return a.bytes == b.bytes;
+}
+
+string ShardFileName(const string& dir, uint32_t shard)
+{
+	char name[32];
+	snprintf(name, sizeof(name), "/shard_%05u.bin", shard);
+	return dir + name;
+}
+
+bool CreateShardRun(const string& dir, const ShardPlan& plan)
+{
+	if (plan.numShards == 0 || plan.sessions == 0)
+		return false;
+#ifdef _WIN32
+	_mkdir(dir.c_str());
+#else
+	mkdir(dir.c_str(), 0755);
+#endif
+	//a plan that's already there has shards hanging off it, only carry on if it's the same run
+	ShardPlan existing;
+	if (ReadShardPlan(dir, existing))
+	{
+		if (existing == plan)
+			return true;
+		DebugPrint("A different run is already planned in ", dir);
+		return false;
+	}
+	string fileName = dir + "/" + PLAN_FILE;
+	FILE *pFile = fopen(fileName.c_str(), "w");
+	if (!pFile)
+	{
+		DebugPrint("Cannot write to ", fileName);
+		return false;
+	}
+	const Paytable& t = plan.table;
+	fprintf(pFile, PLAN_FORMAT("%s"), SHARD_VERSION, PolicyName(plan.policy), plan.maxSpins, (unsigned long long)plan.sessions,
+		(unsigned long long)plan.seed, plan.numShards, t.prizes[0], t.prizes[1], t.prizes[2], t.prizes[3], t.prizes[4], t.prizes[5],
+		t.playCost, t.nudgeCost, t.holdCost, t.maxNudgeHold, t.startCash);
+	bool ok = fclose(pFile) == 0;
+	if (!ok)
+		DebugPrint("Cannot write to ", fileName);
+	return ok;
+}
+
+bool ReadShardPlan(const string& dir, ShardPlan& plan)
+{
+	FILE *pFile = fopen((dir + "/" + PLAN_FILE).c_str(), "r");
+	if (!pFile)
+		return false;
+	unsigned version = 0;
+	char policy[16] = {};
+	unsigned long long sessions = 0, seed = 0;
+	Paytable& t = plan.table;
+	int fields = fscanf(pFile, PLAN_FORMAT("%15s"), &version, policy, &plan.maxSpins, &sessions, &seed, &plan.numShards,
+		&t.prizes[0], &t.prizes[1], &t.prizes[2], &t.prizes[3], &t.prizes[4], &t.prizes[5],
+		&t.playCost, &t.nudgeCost, &t.holdCost, &t.maxNudgeHold, &t.startCash);
+	fclose(pFile);
+	plan.sessions = sessions;
+	plan.seed = seed;
+	if (fields != 17 || version != SHARD_VERSION || !PolicyFromName(policy, plan.policy) || plan.numShards == 0)
+	{
+		DebugPrint("Bad shard plan in ", dir);
+		return false;
+	}
+	return true;
+}
+
+bool SaveShard(const string& fileName, const ShardPlan& plan, uint32_t shard, const SessionStats& stats)
+{
+	Writer w;
+	w.Put(SHARD_MAGIC, 4);
+	w.Put(SHARD_VERSION, 4);
+	PutPlan(w, plan);
+	w.Put(shard, 4);
+	w.Put(stats.sessions);
+	w.Put(stats.busts);
+	w.Put(stats.spins);
+	w.Put(stats.wagered);
+	w.Put(stats.won);
+	w.Put(stats.wonSquared);
+	PutTotals(w, stats.lengthTotals);
+	PutTotals(w, stats.finalCashTotals);
+	PutSketch(w, stats.lengthSketch);
+	PutSketch(w, stats.finalCashSketch);
+	w.Put(Checksum(w.bytes.data(), w.bytes.size()));
+
+	//written aside and renamed so a half written shard never looks finished
+	string tmpName = TempName(fileName);
+	FILE *pFile = fopen(tmpName.c_str(), "wb");
+	if (!pFile)
+	{
+		DebugPrint("Cannot write to ", tmpName);
+		return false;
+	}
+	bool ok = fwrite(w.bytes.data(), 1, w.bytes.size(), pFile) == w.bytes.size() && SyncFile(pFile);
+	ok = (fclose(pFile) == 0) && ok;
+	//replaces one left by another worker on a reclaimed shard, it holds the same result anyway
+#ifdef _WIN32
+	ok = ok && MoveFileExA(tmpName.c_str(), fileName.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+#else
+	ok = ok && rename(tmpName.c_str(), fileName.c_str()) == 0;
+#endif
+	if (!ok)
+	{
+		DebugPrint("Cannot write to ", fileName);
+		remove(tmpName.c_str());
+		return false;
+	}
+	return true;
+}
+
+bool LoadShard(const string& fileName, ShardPlan& plan, uint32_t& shard, SessionStats& stats)
+{
+	FILE *pFile = fopen(fileName.c_str(), "rb");
+	if (!pFile)
+		return false;
+	vector<unsigned char> bytes;
+	unsigned char buf[4096];
+	size_t got;
+	while ((got = fread(buf, 1, sizeof(buf), pFile)) > 0)
+		bytes.insert(bytes.end(), buf, buf + got);
+	fclose(pFile);
+
+	if (bytes.size() < 16)
+		return false;
+	Reader r = { bytes.data(), bytes.data() + bytes.size() };
+	if (r.Get(4) != SHARD_MAGIC || r.Get(4) != SHARD_VERSION)
+		return false;
+	Reader tail = { bytes.data() + bytes.size() - 8, bytes.data() + bytes.size() };
+	if (tail.Get() != Checksum(bytes.data(), bytes.size() - 8))
+	{
+		DebugPrint("Shard failed its checksum: ", fileName);
+		return false;
+	}
+	r.pEnd -= 8;
+	GetPlan(r, plan);
+	shard = (uint32_t)r.Get(4);
+	stats = SessionStats();
+	stats.sessions = r.Get();
+	stats.busts = r.Get();
+	stats.spins = r.Get();
+	stats.wagered = r.Get();
+	stats.won = r.Get();
+	stats.wonSquared = r.Get();
+	GetTotals(r, stats.lengthTotals);
+	GetTotals(r, stats.finalCashTotals);
+	GetSketch(r, stats.lengthSketch);
+	GetSketch(r, stats.finalCashSketch);
+	stats.length = stats.lengthTotals.ToMoments();
+	stats.finalCash = stats.finalCashTotals.ToMoments();
+	if (!r.ok || r.p != r.pEnd)
+	{
+		DebugPrint("Shard is the wrong size: ", fileName);
+		return false;
+	}
+	return true;
+}
+
+int RunShardWorker(const string& dir, int numThreads, bool reclaim)
+{
+	ShardPlan plan;
+	if (!ReadShardPlan(dir, plan))
+		return -1;
+	int played = 0;
+	//unclaimed shards first so a reclaiming worker doesn't double up on live ones while there's other work
+	for (int pass = 0; pass < (reclaim ? 2 : 1); ++pass)
+		for (uint32_t shard = 0; shard < plan.numShards; ++shard)
+		{
+			string fileName = ShardFileName(dir, shard);
+			string claimName = fileName.substr(0, fileName.size() - 4) + ".claim";
+			if (IsFinished(dir, plan, shard) || !Claim(claimName, pass == 1))
+				continue;
+			//someone may have finished it between the check and the claim
+			if (IsFinished(dir, plan, shard))
+			{
+				remove(claimName.c_str());
+				continue;
+			}
+			uint64_t firstBlock, endBlock;
+			plan.ShardBlocks(shard, firstBlock, endBlock);
+			SessionStats stats = RunSessionBlocks(plan.table, plan.policy, plan.sessions, firstBlock, endBlock, plan.maxSpins, plan.seed, numThreads);
+			//let go of it so a plain rerun picks it up again
+			if (!SaveShard(fileName, plan, shard, stats))
+			{
+				remove(claimName.c_str());
+				return -1;
+			}
+			remove(claimName.c_str());
+			++played;
+		}
+	return played;
+}
+
+bool LaunchShardWorkers(const string& exe, const string& dir, int numWorkers, int threadsEach)
+{
+	string threads = to_string(threadsEach);
+	bool ok = true;
+#ifdef _WIN32
+	vector<HANDLE> procs;
+	for (int i = 0; i < numWorkers; ++i)
+	{
+		string cmdLine = "\"" + exe + "\" --shard-run \"" + dir + "\" " + threads;
+		STARTUPINFOA si = { sizeof(si) };
+		PROCESS_INFORMATION pi = {};
+		if (!CreateProcessA(nullptr, &cmdLine[0], nullptr, nullptr, FALSE, 0, nullptr, nullptr, &si, &pi))
+		{
+			DebugPrint("Cannot start a shard worker: ", exe);
+			ok = false;
+			break;
+		}
+		CloseHandle(pi.hThread);
+		procs.push_back(pi.hProcess);
+	}
+	for (HANDLE h : procs)
+	{
+		DWORD code = 1;
+		WaitForSingleObject(h, INFINITE);
+		GetExitCodeProcess(h, &code);
+		ok = ok && code == 0;
+		CloseHandle(h);
+	}
+#else
+	vector<pid_t> procs;
+	for (int i = 0; i < numWorkers; ++i)
+	{
+		const char *args[] = { exe.c_str(), "--shard-run", dir.c_str(), threads.c_str(), nullptr };
+		pid_t pid;
+		if (posix_spawnp(&pid, exe.c_str(), nullptr, nullptr, const_cast<char**>(args), environ) != 0)
+		{
+			DebugPrint("Cannot start a shard worker: ", exe);
+			ok = false;
+			break;
+		}
+		procs.push_back(pid);
+	}
+	for (pid_t pid : procs)
+	{
+		int status = 0;
+		waitpid(pid, &status, 0);
+		ok = ok && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+	}
+#endif
+	return ok;
+}
+
+bool MergeShards(const string& dir, const vector<uint32_t>& shards, SessionStats& total, vector<uint32_t>& missing)
+{
+	ShardPlan plan;
+	if (!ReadShardPlan(dir, plan))
+		return false;
+	vector<uint32_t> wanted = shards;
+	if (wanted.empty())
+		for (uint32_t shard = 0; shard < plan.numShards; ++shard)
+			wanted.push_back(shard);
+	//a shard listed twice still only counts once
+	sort(wanted.begin(), wanted.end());
+	wanted.erase(unique(wanted.begin(), wanted.end()), wanted.end());
+
+	total = SessionStats();
+	missing.clear();
+	for (uint32_t shard : wanted)
+	{
+		ShardPlan filePlan;
+		uint32_t fileShard = 0;
+		SessionStats stats;
+		string fileName = ShardFileName(dir, shard);
+		if (shard >= plan.numShards || !LoadShard(fileName, filePlan, fileShard, stats))
+		{
+			missing.push_back(shard);
+			continue;
+		}
+		if (!(filePlan == plan) || fileShard != shard)
+		{
+			DebugPrint("Shard is from a different run: ", fileName);
+			missing.push_back(shard);
+			continue;
+		}
+		total.Merge(stats);
+	}
+	//the merged Moments depend on the order, the exact totals don't
+	total.length = total.lengthTotals.ToMoments();
+	total.finalCash = total.finalCashTotals.ToMoments();
+	return true;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Sim.h"
+
+/*
+Certification runs are too big for one box, so a run is cut into shards that
+can be played by any number of processes on any number of machines sharing a
+directory. Each shard is a fixed range of session blocks, and every block
+takes its random stream from the master seed and its block number, so the
+merged shards are exactly the run RunSessions would have played in one go.
+
+The directory holds:
+	run.plan			what the run is, written once, every worker reads it
+	shard_NNNNN.claim	someone is playing this shard
+	shard_NNNNN.bin		a finished shard, checksummed
+A shard file only appears once it's complete (written aside then renamed), so
+killing a worker loses at most the shards it was in the middle of. Run the
+workers again and they carry on with whatever isn't finished.
+*/
+
+//what the run is, every shard file carries a copy so mismatched shards can't be merged
+struct ShardPlan {
+	Paytable table;
+	Policy policy = Policy::GREEDY;
+	int maxSpins = 1000;
+	uint64_t sessions = 0;
+	uint64_t seed = 1;
+	uint32_t numShards = 1;
+
+	//which session blocks a shard plays
+	void ShardBlocks(uint32_t shard, uint64_t& firstBlock, uint64_t& endBlock) const;
+	bool operator==(const ShardPlan& other) const;
+};
+
+//run.plan, refuses to overwrite a different plan that's already there
+bool CreateShardRun(const std::string& dir, const ShardPlan& plan);
+bool ReadShardPlan(const std::string& dir, ShardPlan& plan);
+std::string ShardFileName(const std::string& dir, uint32_t shard);
+
+//one finished shard, false if it's missing, damaged or from a different version
+bool SaveShard(const std::string& fileName, const ShardPlan& plan, uint32_t shard, const SessionStats& stats);
+bool LoadShard(const std::string& fileName, ShardPlan& plan, uint32_t& shard, SessionStats& stats);
+
+/*
+Claim and play shards until there are none left that are unfinished and
+unclaimed. Claims left behind by a worker that was killed are only taken over
+with reclaim, as on shared storage there's no telling a dead worker from a
+slow one. Returns how many shards this worker played, -1 on an error.
+*/
+int RunShardWorker(const std::string& dir, int numThreads, bool reclaim);
+
+//start numWorkers copies of exe running the shards of dir and wait for them all
+bool LaunchShardWorkers(const std::string& exe, const std::string& dir, int numWorkers, int threadsEach);
+
+/*
+Add up the finished shards in the list (all of them if it's empty). Counts
+and histograms are exact sums, so any subset in any order gives the same
+answer. missing gets the shards that aren't finished or fail their checks.
+*/
+bool MergeShards(const std::string& dir, const std::vector<uint32_t>& shards, SessionStats& total, std::vector<uint32_t>& missing);
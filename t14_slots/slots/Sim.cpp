@@ -0,0 +1,474 @@
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <vector>
+
+#include "Parallel.h"
+#include "Sim.h"
+
+using namespace std;
+
+//how much bigger each sketch bucket is than the last
+static const double SKETCH_GROWTH = 1.02;
+
+Paytable::Paytable()
+{
+	for (int i = 0; i < GC::NUM_FRUIT; ++i)
+		prizes[i] = GC::CASH_PRIZES[i];
+}
+
+double FruitOdds(int fruit)
+{
+	//every reel stop is equally likely, the fairness battery checks GetRange does that
+	assert(fruit >= 0 && fruit < GC::NUM_FRUIT);
+	return 1.0 / GC::NUM_FRUIT;
+}
+
+//*************************************************
+
+void Moments::Add(double x)
+{
+	if (n == 0)
+		min = max = x;
+	else
+	{
+		min = std::min(min, x);
+		max = std::max(max, x);
+	}
+	++n;
+	double delta = x - mean;
+	mean += delta / n;
+	m2 += delta * (x - mean);
+}
+
+void Moments::Merge(const Moments& other)
+{
+	if (other.n == 0)
+		return;
+	if (n == 0)
+	{
+		*this = other;
+		return;
+	}
+	uint64_t total = n + other.n;
+	double delta = other.mean - mean;
+	mean += delta * other.n / total;
+	m2 += other.m2 + delta * delta * ((double)n * other.n / total);
+	min = std::min(min, other.min);
+	max = std::max(max, other.max);
+	n = total;
+}
+
+double Moments::StdDev() const
+{
+	return sqrt(Variance());
+}
+
+void IntTotals::Add(uint64_t x)
+{
+	min = n ? std::min(min, x) : x;
+	max = n ? std::max(max, x) : x;
+	++n;
+	sum += x;
+	uint64_t sq = x * x;
+	sqLo += sq;
+	sqHi += sqLo < sq;
+}
+
+void IntTotals::Merge(const IntTotals& other)
+{
+	if (other.n == 0)
+		return;
+	min = n ? std::min(min, other.min) : other.min;
+	max = n ? std::max(max, other.max) : other.max;
+	n += other.n;
+	sum += other.sum;
+	sqLo += other.sqLo;
+	sqHi += other.sqHi + (sqLo < other.sqLo);
+}
+
+Moments IntTotals::ToMoments() const
+{
+	Moments m;
+	if (n == 0)
+		return m;
+	//the squares can be well past what a double holds exactly, take the difference as wide as we can
+	long double sumSq = sqHi * 18446744073709551616.0L + sqLo;
+	m.n = n;
+	m.mean = (double)sum / n;
+	m.m2 = (double)std::max(0.0L, sumSq - (long double)sum * sum / n);
+	m.min = (double)min;
+	m.max = (double)max;
+	return m;
+}
+
+void QuantileSketch::Add(double x)
+{
+	++total;
+	if (x < 1)
+	{
+		++low;
+		return;
+	}
+	int i = (int)ceil(log(x) / log(SKETCH_GROWTH));
+	++buckets[std::min(std::max(i, 0), NUM_BUCKETS - 1)];
+}
+
+void QuantileSketch::Merge(const QuantileSketch& other)
+{
+	low += other.low;
+	total += other.total;
+	for (int i = 0; i < NUM_BUCKETS; ++i)
+		buckets[i] += other.buckets[i];
+}
+
+double QuantileSketch::Quantile(double q) const
+{
+	if (total == 0)
+		return 0;
+	uint64_t rank = (uint64_t)(q * (total - 1));
+	if (rank < low)
+		return 0;
+	uint64_t seen = low;
+	for (int i = 0; i < NUM_BUCKETS; ++i)
+	{
+		seen += buckets[i];
+		if (seen > rank)
+		{
+			//middle of the bucket, so we're never more than 1% out
+			if (i == 0)
+				return 1;
+			return 2 * pow(SKETCH_GROWTH, i) / (SKETCH_GROWTH + 1);
+		}
+	}
+	return pow(SKETCH_GROWTH, NUM_BUCKETS - 1);
+}
+
+//*************************************************
+
+bool PolicyFromName(const string& name, Policy& policy)
+{
+	for (Policy p : { Policy::SPIN_ONLY, Policy::NUDGE_FOUR, Policy::GREEDY })
+		if (name == PolicyName(p))
+		{
+			policy = p;
+			return true;
+		}
+	return false;
+}
+
+const char* PolicyName(Policy policy)
+{
+	switch (policy)
+	{
+	case Policy::SPIN_ONLY: return "spin";
+	case Policy::NUDGE_FOUR: return "nudge";
+	case Policy::GREEDY: return "greedy";
+	}
+	return "?";
+}
+
+void SessionStats::Merge(const SessionStats& other)
+{
+	sessions += other.sessions;
+	busts += other.busts;
+	spins += other.spins;
+	wagered += other.wagered;
+	won += other.won;
+	wonSquared += other.wonSquared;
+	length.Merge(other.length);
+	finalCash.Merge(other.finalCash);
+	lengthTotals.Merge(other.lengthTotals);
+	finalCashTotals.Merge(other.finalCashTotals);
+	lengthSketch.Merge(other.lengthSketch);
+	finalCashSketch.Merge(other.finalCashSketch);
+}
+
+double SessionStats::Volatility(const Paytable& table) const
+{
+	if (spins == 0)
+		return 0;
+	double mean = (double)won / spins;
+	return sqrt(max(0.0, (double)wonSquared / spins - mean * mean)) / table.playCost;
+}
+
+void SessionStats::Print(FILE *pFile) const
+{
+	fprintf(pFile, "sessions %llu, spins %llu, busted %.2f%%, return to player %.4f%%\n",
+		(unsigned long long)sessions, (unsigned long long)spins,
+		sessions ? 100.0 * busts / sessions : 0.0, 100 * RTP());
+	fprintf(pFile, "\tmean\tstddev\tmin\tp10\tp50\tp90\tp99\tmax\n");
+	const pair<const char*, pair<const Moments*, const QuantileSketch*>> rows[] = {
+		{ "spins", { &length, &lengthSketch } },
+		{ "cash", { &finalCash, &finalCashSketch } } };
+	for (auto& row : rows)
+	{
+		const Moments& m = *row.second.first;
+		const QuantileSketch& s = *row.second.second;
+		fprintf(pFile, "%s\t%.2f\t%.2f\t%.0f\t%.0f\t%.0f\t%.0f\t%.0f\t%.0f\n", row.first,
+			m.mean, m.StdDev(), m.min, s.Quantile(0.1), s.Quantile(0.5), s.Quantile(0.9), s.Quantile(0.99), m.max);
+	}
+}
+
+//*************************************************
+
+//headless copy of the reels, no animation, the result is there straight away
+struct SimReels
+{
+	int fruit[GC::NUM_REELS];
+
+	//draw() picks the fruit for one reel
+	template <typename Draw>
+	void Spin(Draw& draw, int except = -1) {
+		for (int i = 0; i < GC::NUM_REELS; ++i)
+			if (i != except)
+				fruit[i] = draw();
+	}
+	bool Won() const {
+		for (int i = 1; i < GC::NUM_REELS; ++i)
+			if (fruit[i] != fruit[0])
+				return false;
+		return true;
+	}
+	//if every reel but skip shows the same fruit return it, else -1
+	int OthersMatch(int skip) const {
+		int f = fruit[skip == 0 ? 1 : 0];
+		for (int i = 0; i < GC::NUM_REELS; ++i)
+			if (i != skip && fruit[i] != f)
+				return -1;
+		return f;
+	}
+};
+
+//one go at nudging or holding
+struct SimMove
+{
+	bool hold = false;
+	int reel = -1;		//-1 means leave it and spin again
+};
+
+static SimMove ChooseMove(const Paytable& table, Policy policy, const SimReels& reels)
+{
+	SimMove best;
+	if (policy == Policy::SPIN_ONLY)
+		return best;
+	double bestValue = 0;
+	for (int i = 0; i < GC::NUM_REELS; ++i)
+	{
+		//nudge: the other four have to be a line already
+		int f = reels.OthersMatch(i);
+		if (f >= 0)
+		{
+			if (policy == Policy::NUDGE_FOUR)
+			{
+				best.reel = i;
+				return best;
+			}
+			double value = FruitOdds(f) * table.prizes[f] - table.nudgeCost;
+			if (value > bestValue)
+			{
+				bestValue = value;
+				best.hold = false;
+				best.reel = i;
+			}
+		}
+		if (policy == Policy::GREEDY)
+		{
+			//hold: the other four all have to come up the same as this one
+			int h = reels.fruit[i];
+			double value = pow(FruitOdds(h), GC::NUM_REELS - 1) * table.prizes[h] - table.holdCost;
+			if (value > bestValue)
+			{
+				bestValue = value;
+				best.hold = true;
+				best.reel = i;
+			}
+		}
+	}
+	return best;
+}
+
+/*
+One spin plus whatever nudges and holds the policy wants and cash allows,
+the costs come out of cash. Returns the fruit that made a line or -1.
+*/
+template <typename Draw>
+static int PlaySpin(const Paytable& table, Policy policy, int& cash, Draw& draw)
+{
+	SimReels reels;
+	cash -= table.playCost;
+	reels.Spin(draw);
+	int nudgeHold = table.maxNudgeHold;
+	bool won = reels.Won();
+	while (!won && nudgeHold > 0 && cash > table.holdCost && cash > table.nudgeCost)
+	{
+		SimMove move = ChooseMove(table, policy, reels);
+		if (move.reel < 0)
+			break;
+		cash -= move.hold ? table.holdCost : table.nudgeCost;
+		--nudgeHold;
+		if (move.hold)
+			reels.Spin(draw, move.reel);
+		else
+			reels.fruit[move.reel] = draw();
+		won = reels.Won();
+	}
+	return won ? reels.fruit[0] : -1;
+}
+
+void PlaySession(const Paytable& table, Policy policy, int maxSpins, RndStream& rnd, SessionStats& stats)
+{
+	auto draw = [&rnd]() { return rnd.GetRange(0, GC::NUM_FRUIT - 1); };
+	int cash = table.startCash;
+	int spins = 0;
+	//same gate as the cabinet, you need more than the cost of a spin to start another
+	while (spins < maxSpins && cash > table.playCost)
+	{
+		int before = cash;
+		int fruit = PlaySpin(table, policy, cash, draw);
+		stats.wagered += before - cash;
+		++spins;
+		if (fruit >= 0)
+		{
+			int prize = table.prizes[fruit];
+			cash += prize;
+			stats.won += prize;
+			stats.wonSquared += (uint64_t)prize * prize;
+		}
+	}
+	++stats.sessions;
+	if (cash <= table.playCost && spins < maxSpins)
+		++stats.busts;
+	stats.spins += spins;
+	stats.length.Add(spins);
+	stats.finalCash.Add(cash);
+	stats.lengthTotals.Add(spins);
+	stats.finalCashTotals.Add(cash);
+	stats.lengthSketch.Add(spins);
+	stats.finalCashSketch.Add(cash);
+}
+
+SessionStats RunSessions(const Paytable& table, Policy policy, uint64_t numSessions, int maxSpins, uint64_t seed, int numThreads)
+{
+	return RunSessionBlocks(table, policy, numSessions, 0, (numSessions + SESSION_BLOCK - 1) / SESSION_BLOCK, maxSpins, seed, numThreads);
+}
+
+SessionStats RunSessionBlocks(const Paytable& table, Policy policy, uint64_t numSessions, uint64_t firstBlock, uint64_t endBlock,
+	int maxSpins, uint64_t seed, int numThreads)
+{
+	//one set of stats each, the sketches are big so they live on the heap
+	vector<SessionStats> results(NumWorkers(numThreads));
+	int used = RunBlockRange(numSessions, SESSION_BLOCK, firstBlock, endBlock, seed, (int)results.size(), [&](int idx, RndStream& rnd, uint64_t first, uint64_t end) {
+		for (uint64_t s = first; s < end; ++s)
+			PlaySession(table, policy, maxSpins, rnd, results[idx]);
+	});
+
+	SessionStats total;
+	for (int i = 0; i < used; ++i)
+		total.Merge(results[i]);
+	return total;
+}
+
+//*************************************************
+
+int JackpotFruit(const Paytable& table)
+{
+	return (int)(max_element(table.prizes, table.prizes + GC::NUM_FRUIT) - table.prizes);
+}
+
+void JackpotEstimate::Merge(const JackpotEstimate& other)
+{
+	plain.Merge(other.plain);
+	weighted.Merge(other.weighted);
+	spent.Merge(other.spent);
+	plainHits += other.plainHits;
+	weightedHits += other.weightedHits;
+}
+
+//95% confidence, normal approximation
+static void PrintInterval(FILE *pFile, const char* name, const Moments& m, uint64_t hits)
+{
+	double half = m.n ? 1.96 * m.StdDev() / sqrt((double)m.n) : 0;
+	fprintf(pFile, "%s\t%.4e\t%.4e\t%.4e\t%.2f%%\t%llu\n", name, m.mean, max(0.0, m.mean - half), m.mean + half,
+		m.mean > 0 ? 100 * half / m.mean : 0.0, (unsigned long long)hits);
+}
+
+void JackpotEstimate::Print(FILE *pFile, const Paytable& table) const
+{
+	fprintf(pFile, "jackpot: a line of fruit %d paying %d, %llu spins each way, tilted to %.3f per reel\n",
+		fruit, table.prizes[fruit], (unsigned long long)plain.n, tilt);
+	fprintf(pFile, "chance\tmean\tlow\thigh\t+/-\thits\n");
+	PrintInterval(pFile, "plain", plain, plainHits);
+	PrintInterval(pFile, "tilted", weighted, weightedHits);
+	//share of RTP = prize * chance / average stake, the stake has a tiny error next to the chance
+	double stake = spent.mean > 0 ? spent.mean : 1;
+	fprintf(pFile, "share of RTP: plain %.4e, tilted %.4e\n",
+		table.prizes[fruit] * plain.mean / stake, table.prizes[fruit] * weighted.mean / stake);
+	if (plain.Variance() > 0 && weighted.Variance() > 0)
+		fprintf(pFile, "tilted needs %.0fx fewer spins for the same interval\n", plain.Variance() / weighted.Variance());
+	else
+		fprintf(pFile, "not enough plain hits to compare, run more spins\n");
+}
+
+JackpotEstimate EstimateJackpot(const Paytable& table, Policy policy, uint64_t numSpins, double tilt, uint64_t seed, int numThreads)
+{
+	const int target = JackpotFruit(table);
+	//tilted odds: the jackpot fruit comes up with chance tilt, the rest keep their proportions
+	//every tilted draw multiplies the spin's weight by real odds / tilted odds so the average stays unbiased
+	double cumulative[GC::NUM_FRUIT];
+	double ratio[GC::NUM_FRUIT];
+	double sum = 0;
+	for (int f = 0; f < GC::NUM_FRUIT; ++f)
+	{
+		double p = FruitOdds(f);
+		double q = (f == target) ? tilt : p * (1 - tilt) / (1 - FruitOdds(target));
+		ratio[f] = p / q;
+		sum += q;
+		cumulative[f] = sum;
+	}
+	cumulative[GC::NUM_FRUIT - 1] = 1;
+
+	//plenty of cash so the policy is never held back by money, we want the odds of a spin
+	const int CASH = 1 << 30;
+	vector<JackpotEstimate> results(NumWorkers(numThreads));
+	int used = RunBlocks(numSpins, SESSION_BLOCK, seed, (int)results.size(), [&](int idx, RndStream& rnd, uint64_t first, uint64_t end) {
+		JackpotEstimate& est = results[idx];
+		double weight = 1;
+		int draws = 0;
+		auto plainDraw = [&rnd]() { return rnd.GetRange(0, GC::NUM_FRUIT - 1); };
+		//only the opening spin is tilted, nudges and holds use the real odds so
+		//a long run of failed nudges can't turn into a huge weight
+		auto tiltedDraw = [&]() {
+			if (draws++ >= GC::NUM_REELS)
+				return rnd.GetRange(0, GC::NUM_FRUIT - 1);
+			double alpha = (rnd.Next() >> 11) * (1.0 / 9007199254740992.0);
+			int f = 0;
+			while (alpha >= cumulative[f])
+				++f;
+			weight *= ratio[f];
+			return f;
+		};
+		for (uint64_t s = first; s < end; ++s)
+		{
+			int cash = CASH;
+			bool hit = PlaySpin(table, policy, cash, plainDraw) == target;
+			est.plain.Add(hit);
+			est.plainHits += hit;
+			est.spent.Add(CASH - cash);
+
+			cash = CASH;
+			weight = 1;
+			draws = 0;
+			hit = PlaySpin(table, policy, cash, tiltedDraw) == target;
+			est.weighted.Add(hit ? weight : 0);
+			est.weightedHits += hit;
+		}
+	});
+
+	JackpotEstimate total;
+	total.fruit = target;
+	total.tilt = tilt;
+	for (int i = 0; i < used; ++i)
+		total.Merge(results[i]);
+	return total;
+}
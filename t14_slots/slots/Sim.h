@@ -0,0 +1,162 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+#include "GameRules.h"
+#include "Utils.h"
+
+/*
+Headless versions of the slot machine for answering "what happens if..."
+questions without sitting at the cabinet. The rules match Slots and Game
+(spin, win on a full line, nudge one reel or hold one and spin the rest)
+minus the timers and graphics.
+*/
+
+//the numbers that decide the odds, starts off as what the cabinet uses
+struct Paytable {
+	int prizes[GC::NUM_FRUIT];
+	int playCost = GC::PLAY_COST;
+	int nudgeCost = GC::NUDGE_COST;
+	int holdCost = GC::HOLD_COST;
+	int maxNudgeHold = GC::MAX_NUDGEHOLD;
+	int startCash = GC::START_CASH;
+
+	Paytable();
+};
+
+//chance of each fruit coming up on one reel
+double FruitOdds(int fruit);
+
+//*************************************************
+//streaming statistics, each thread keeps its own and they're merged at the end
+
+//running mean and variance (Welford), merged with Chan's formula
+struct Moments {
+	uint64_t n = 0;
+	double mean = 0;
+	double m2 = 0;		//sum of squared differences from the mean
+	double min = 0;
+	double max = 0;
+
+	void Add(double x);
+	void Merge(const Moments& other);
+	double Variance() const { return n > 1 ? m2 / (n - 1) : 0; }
+	double StdDev() const;
+};
+
+/*
+Exact totals of whole numbers. Merging Moments rounds differently depending on
+the order, these add up to the same bits whichever order the pieces come in,
+so results merged from separate processes can be checked against each other.
+*/
+struct IntTotals {
+	uint64_t n = 0;
+	uint64_t sum = 0;
+	uint64_t sqLo = 0;			//sum of squares, 128 bits
+	uint64_t sqHi = 0;
+	uint64_t min = 0;
+	uint64_t max = 0;
+
+	void Add(uint64_t x);
+	void Merge(const IntTotals& other);
+	Moments ToMoments() const;
+};
+
+/*
+Log bucketed histogram that doubles as a quantile sketch. Bucket i holds
+values in (G^(i-1), G^i] so any quantile read back is within 1% of the real
+one, whatever the distribution, in a fixed amount of memory. Values under 1
+(busting with nothing left) share their own bucket.
+*/
+struct QuantileSketch {
+	static const int NUM_BUCKETS = 1200;	//covers up to about 2e10
+	uint64_t low = 0;						//values < 1
+	uint64_t total = 0;
+	uint64_t buckets[NUM_BUCKETS] = {};
+
+	void Add(double x);
+	void Merge(const QuantileSketch& other);
+	double Quantile(double q) const;
+};
+
+//*************************************************
+//sessions: start with startCash and play until you can't afford a spin or hit maxSpins
+
+//how a simulated player makes decisions
+enum class Policy {
+	SPIN_ONLY,		//never nudge or hold
+	NUDGE_FOUR,		//nudge the odd reel out whenever four match
+	GREEDY			//take whichever nudge/hold pays best on average, if any pays at all
+};
+bool PolicyFromName(const std::string& name, Policy& policy);
+const char* PolicyName(Policy policy);
+
+//everything we learned from a batch of sessions
+struct SessionStats {
+	uint64_t sessions = 0;
+	uint64_t busts = 0;				//ran out of money before maxSpins
+	uint64_t spins = 0;
+	uint64_t wagered = 0;			//spent on spins, nudges and holds
+	uint64_t won = 0;
+	uint64_t wonSquared = 0;		//sum of each spin's winnings squared, for volatility
+	Moments length;					//spins per session
+	Moments finalCash;
+	IntTotals lengthTotals;			//exact versions of the two above
+	IntTotals finalCashTotals;
+	QuantileSketch lengthSketch;
+	QuantileSketch finalCashSketch;
+
+	void Merge(const SessionStats& other);
+	double RTP() const { return wagered ? (double)won / wagered : 0; }
+	//standard deviation of what one spin pays out, in spins
+	double Volatility(const Paytable& table) const;
+	void Print(FILE *pFile) const;
+};
+
+//sessions are dealt out to threads in blocks this big
+const uint64_t SESSION_BLOCK = 4096;
+
+//play one session
+void PlaySession(const Paytable& table, Policy policy, int maxSpins, RndStream& rnd, SessionStats& stats);
+
+/*
+Play lots of sessions across numThreads (0 = all cores). Sessions are dealt
+out in fixed size blocks, each with its own random stream made from the seed
+and the block number, so the same seed gives the same sessions however many
+threads there are.
+*/
+SessionStats RunSessions(const Paytable& table, Policy policy, uint64_t numSessions, int maxSpins, uint64_t seed, int numThreads = 0);
+//just blocks [firstBlock, endBlock) of the same run, so a run can be split up and merged back exactly
+SessionStats RunSessionBlocks(const Paytable& table, Policy policy, uint64_t numSessions, uint64_t firstBlock, uint64_t endBlock,
+	int maxSpins, uint64_t seed, int numThreads = 0);
+
+//*************************************************
+/*
+The jackpot (a line of the best paying fruit) comes up so rarely that plain
+simulation needs huge runs to pin down how often it pays. Importance sampling
+plays the same spins with the opening spin's reels tilted towards the jackpot
+fruit and weights each hit by how much likelier the tilt made it, which is
+unbiased and needs far fewer spins. Both run side by side so they can be compared.
+*/
+
+//which fruit pays the most
+int JackpotFruit(const Paytable& table);
+
+struct JackpotEstimate {
+	int fruit = 0;
+	double tilt = 0;			//chance of the jackpot fruit on each reel when tilted
+	Moments plain;				//1 for a jackpot, 0 otherwise, real odds
+	Moments weighted;			//real odds / tilted odds for a jackpot, 0 otherwise, tilted odds
+	Moments spent;				//stake per spin including nudges and holds, real odds
+	uint64_t plainHits = 0;
+	uint64_t weightedHits = 0;
+
+	void Merge(const JackpotEstimate& other);
+	//chance per spin and share of RTP with 95% confidence intervals
+	void Print(FILE *pFile, const Paytable& table) const;
+};
+
+//play numSpins single spins each way, with the policy free to nudge and hold as much as it likes
+JackpotEstimate EstimateJackpot(const Paytable& table, Policy policy, uint64_t numSpins, double tilt = 0.5, uint64_t seed = 1, int numThreads = 0);
@@ -0,0 +1,134 @@
+#include <assert.h>
+#include <cstddef>
+#include <cstring>
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "Snapshot.h"
+#include "Utils.h"
+
+using namespace std;
+
+namespace {
+	const size_t SLOT_BYTES = 256;
+	const size_t FILE_BYTES = SLOT_BYTES * 2;
+	static_assert(sizeof(MachineState) <= SLOT_BYTES, "MachineState has outgrown its slot");
+
+	//FNV-1a, enough to spot a torn write
+	uint32_t Checksum(const MachineState& state)
+	{
+		const unsigned char *p = reinterpret_cast<const unsigned char*>(&state);
+		uint32_t h = 2166136261u;
+		for (size_t i = 0; i < offsetof(MachineState, checksum); ++i)
+			h = (h ^ p[i]) * 16777619u;
+		return h;
+	}
+
+	bool IsValid(const MachineState& state)
+	{
+		return state.magic == MachineState::MAGIC && state.version == MachineState::VERSION && state.checksum == Checksum(state);
+	}
+}
+
+bool SnapshotFile::Open(const string& fileName)
+{
+	assert(!pView);
+#ifdef _WIN32
+	HANDLE file = CreateFileA(fileName.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		DebugPrint("Cannot open snapshot: ", fileName);
+		return false;
+	}
+	HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READWRITE, 0, (DWORD)FILE_BYTES, nullptr);
+	pView = mapping ? MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, FILE_BYTES) : nullptr;
+	if (!pView) {
+		DebugPrint("Cannot map snapshot: ", fileName);
+		if (mapping)
+			CloseHandle(mapping);
+		CloseHandle(file);
+		return false;
+	}
+	hFile = file;
+	hMapping = mapping;
+#else
+	int fd = open(fileName.c_str(), O_RDWR | O_CREAT, 0644);
+	if (fd < 0 || ftruncate(fd, FILE_BYTES) != 0) {
+		DebugPrint("Cannot open snapshot: ", fileName);
+		if (fd >= 0)
+			close(fd);
+		return false;
+	}
+	void *p = mmap(nullptr, FILE_BYTES, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (p == MAP_FAILED) {
+		DebugPrint("Cannot map snapshot: ", fileName);
+		return false;
+	}
+	pView = p;
+#endif
+	//find out which slot is newest so the next save goes in the other one
+	MachineState state;
+	Load(state);
+	return true;
+}
+
+void SnapshotFile::Close()
+{
+	if (!pView)
+		return;
+#ifdef _WIN32
+	UnmapViewOfFile(pView);
+	CloseHandle(hMapping);
+	CloseHandle(hFile);
+	hMapping = hFile = nullptr;
+#else
+	munmap(pView, FILE_BYTES);
+#endif
+	pView = nullptr;
+}
+
+void SnapshotFile::Save(MachineState& state)
+{
+	assert(pView);
+	int slot = 1 - lastSlot;
+	state.magic = MachineState::MAGIC;
+	state.version = MachineState::VERSION;
+	state.seq = lastSeq + 1;
+	state.checksum = Checksum(state);
+	char *pSlot = static_cast<char*>(pView) + slot * SLOT_BYTES;
+	memcpy(pSlot, &state, sizeof(state));
+#ifdef _WIN32
+	//FlushViewOfFile only starts the write, FlushFileBuffers waits for it to reach the disk
+	FlushViewOfFile(pSlot, sizeof(state));
+	FlushFileBuffers((HANDLE)hFile);
+#else
+	//msync wants a page aligned address, both slots share the first page
+	msync(pView, FILE_BYTES, MS_SYNC);
+#endif
+	lastSeq = state.seq;
+	lastSlot = slot;
+}
+
+bool SnapshotFile::Load(MachineState& state)
+{
+	assert(pView);
+	const MachineState *pSlots[2] = {
+		static_cast<const MachineState*>(pView),
+		reinterpret_cast<const MachineState*>(static_cast<const char*>(pView) + SLOT_BYTES)
+	};
+	int best = -1;
+	for (int i = 0; i < 2; ++i)
+		if (IsValid(*pSlots[i]) && (best < 0 || pSlots[i]->seq > pSlots[best]->seq))
+			best = i;
+	if (best < 0)
+		return false;
+	memcpy(&state, pSlots[best], sizeof(state));
+	lastSeq = state.seq;
+	lastSlot = best;
+	return true;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "OutcomePool.h"
+
+/*
+Everything needed to put the machine back exactly as it was after a power cut.
+Fixed layout, no pointers, so it can be copied straight in and out of a file.
+Timers are stored as time remaining because the game clock restarts at zero.
+Bump VERSION whenever the layout changes, older snapshots are then ignored.
+*/
+struct MachineState
+{
+	static const uint32_t MAGIC = 0x534c4f54;	//"SLOT"
+	static const uint32_t VERSION = 2;
+	static const int NUM_REELS = 5;
+	static const int NAME_SIZE = 16;
+
+	uint32_t magic = MAGIC;
+	uint32_t version = VERSION;
+	uint64_t seq = 0;			//which save this is, the newest valid one wins
+	int32_t mode = 0;			//Game::Mode
+	int32_t cash = 0;
+	int32_t nudges = 0;			//nudge/hold counter that goes into PLAYS
+	int32_t nudgeHoldCtr = 0;
+	uint8_t spinning = 0;
+	uint8_t winningRound = 0;
+	uint8_t dealtWhole = 0;
+	uint8_t pad = 0;
+	float spinRemaining = 0;	//seconds until all reels stop
+	struct Reel {
+		int32_t result = 0;
+		float spinRemaining = 0;	//0 if it isn't spinning
+		uint8_t hold = 0;
+		uint8_t pad[3] = {};
+	} reels[NUM_REELS];
+	SpinOutcome dealt = {};		//what the spinning reels will stop on, already paid for
+	char name[NAME_SIZE] = {};
+	uint32_t checksum = 0;		//over everything above
+};
+
+/*
+A small memory mapped file with two copies of the state in it. Each save goes
+into the slot that doesn't hold the latest good copy and is checksummed, so if
+the power goes mid write the other slot is still intact.
+*/
+struct SnapshotFile
+{
+	void *pView = nullptr;		//the mapped file
+	void *hFile = nullptr;		//platform handles
+	void *hMapping = nullptr;
+	uint64_t lastSeq = 0;		//seq of the newest slot
+	int lastSlot = 1;			//which slot holds it
+
+	//map the file, creating it if it doesn't exist
+	bool Open(const std::string& fileName);
+	void Close();
+	//write to the older slot and flush it to disk
+	void Save(MachineState& state);
+	//the newest slot that passes its checksum, false if there isn't one
+	bool Load(MachineState& state);
+};
@@ -0,0 +1,147 @@
+#include <assert.h>
+#include <cstring>
+#include <new>
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "Telemetry.h"
+#include "Utils.h"
+
+using namespace std;
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "the seqlock has to be lock free to work across processes");
+static_assert(sizeof(TelemetryData) % 8 == 0, "keep TelemetryData a whole number of 64 bit words");
+
+namespace {
+	//names look different on each platform, pass the same one to the game and the monitor
+	string PlatformName(const string& name)
+	{
+#ifdef _WIN32
+		return "Local\\" + name;
+#else
+		return "/" + name;
+#endif
+	}
+}
+
+bool TelemetryFile::Create(const string& segName)
+{
+	assert(!pSeg);
+	name = PlatformName(segName);
+	void *pView = nullptr;
+#ifdef _WIN32
+	HANDLE mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0, (DWORD)sizeof(TelemetrySegment), name.c_str());
+	pView = mapping ? MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(TelemetrySegment)) : nullptr;
+	if (!pView) {
+		DebugPrint("Cannot create telemetry: ", name);
+		if (mapping)
+			CloseHandle(mapping);
+		return false;
+	}
+	hMapping = mapping;
+#else
+	int fd = shm_open(name.c_str(), O_RDWR | O_CREAT, 0644);
+	if (fd < 0 || ftruncate(fd, sizeof(TelemetrySegment)) != 0) {
+		DebugPrint("Cannot create telemetry: ", name);
+		if (fd >= 0)
+			close(fd);
+		return false;
+	}
+	pView = mmap(nullptr, sizeof(TelemetrySegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (pView == MAP_FAILED) {
+		DebugPrint("Cannot map telemetry: ", name);
+		return false;
+	}
+#endif
+	//start fresh, the magic goes in last so a monitor never sees a half made segment
+	pSeg = new (pView) TelemetrySegment;
+	atomic_thread_fence(memory_order_release);
+	pSeg->magic = TelemetrySegment::MAGIC;
+	owner = true;
+	return true;
+}
+
+bool TelemetryFile::Attach(const string& segName)
+{
+	assert(!pSeg);
+	name = PlatformName(segName);
+	void *pView = nullptr;
+#ifdef _WIN32
+	HANDLE mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, name.c_str());
+	pView = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, sizeof(TelemetrySegment)) : nullptr;
+	if (!pView) {
+		if (mapping)
+			CloseHandle(mapping);
+		return false;
+	}
+	hMapping = mapping;
+#else
+	int fd = shm_open(name.c_str(), O_RDONLY, 0);
+	if (fd < 0)
+		return false;
+	struct stat st;
+	bool big = fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(TelemetrySegment);
+	pView = big ? mmap(nullptr, sizeof(TelemetrySegment), PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+	close(fd);
+	if (pView == MAP_FAILED)
+		return false;
+#endif
+	pSeg = static_cast<TelemetrySegment*>(pView);
+	owner = false;
+	if (pSeg->magic != TelemetrySegment::MAGIC || pSeg->version != TelemetrySegment::VERSION || pSeg->size != sizeof(TelemetrySegment)) {
+		DebugPrint("Telemetry layout doesn't match: ", name);
+		Close();
+		return false;
+	}
+	return true;
+}
+
+void TelemetryFile::Close()
+{
+	if (!pSeg)
+		return;
+#ifdef _WIN32
+	UnmapViewOfFile(pSeg);
+	CloseHandle(hMapping);
+	hMapping = nullptr;
+#else
+	munmap(pSeg, sizeof(TelemetrySegment));
+	if (owner)
+		shm_unlink(name.c_str());
+#endif
+	pSeg = nullptr;
+}
+
+void TelemetryFile::Publish(const TelemetryData& data)
+{
+	if (!pSeg)
+		return;
+	//only this thread writes seq so a plain load is enough to read it
+	uint64_t seq = pSeg->seq.load(memory_order_relaxed);
+	pSeg->seq.store(seq + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	memcpy(&pSeg->data, &data, sizeof(data));
+	pSeg->seq.store(seq + 2, memory_order_release);
+}
+
+bool TelemetryFile::Sample(TelemetryData& data, int maxTries) const
+{
+	assert(pSeg);
+	for (int i = 0; i < maxTries; ++i) {
+		uint64_t before = pSeg->seq.load(memory_order_acquire);
+		if (before & 1)
+			continue;	//mid write
+		memcpy(&data, &pSeg->data, sizeof(data));
+		atomic_thread_fence(memory_order_acquire);
+		if (pSeg->seq.load(memory_order_relaxed) == before)
+			return true;
+	}
+	return false;
+}
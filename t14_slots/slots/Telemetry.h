@@ -0,0 +1,71 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+/*
+Live numbers from the cabinet for floor monitoring. The game writes them into
+a small named shared memory segment every update, a monitor maps the same
+segment and samples it as often as it likes without making a single syscall
+or slowing the game down. Counters only ever go up, so a monitor works out
+rates from the difference between two samples.
+Fixed layout, no pointers. Bump VERSION whenever it changes, add new fields
+at the end of TelemetryData.
+*/
+struct TelemetryData
+{
+	uint64_t updates = 0;		//how many times the game has published
+	uint64_t timeUs = 0;		//steady clock when it was published
+	uint64_t spins = 0;
+	uint64_t coinIn = 0;		//spent on spins, nudges and holds
+	uint64_t coinOut = 0;		//paid out in winnings
+	uint64_t dbCalls = 0;		//database round trips made by the game
+	uint64_t dbTotalUs = 0;		//time spent in them
+	int32_t mode = 0;			//Game::Mode
+	int32_t cash = 0;
+	float frameMs = 0;			//last frame
+	float frameMsAvg = 0;		//smoothed over roughly the last second
+	float frameMsMax = 0;		//worst since the previous publish
+	float dbLastUs = 0;
+	float dbMaxUs = 0;			//worst since start up
+	uint32_t poolDepth = 0;		//spins ready in the outcome pool
+	uint64_t poolMisses = 0;	//spins rolled on the spot because the pool was empty
+};
+
+/*
+The segment is guarded by a sequence lock: the writer makes seq odd, copies
+the data in and makes it even again. A reader copies the data out and only
+keeps it if seq was the same even number before and after. There's only ever
+one writer (the game's update thread) and it never waits for readers.
+*/
+struct TelemetrySegment
+{
+	static const uint32_t MAGIC = 0x534c544d;	//"SLTM"
+	static const uint32_t VERSION = 2;
+
+	uint32_t magic = 0;
+	uint32_t version = VERSION;
+	uint32_t size = sizeof(TelemetrySegment);
+	uint32_t pad = 0;
+	std::atomic<uint64_t> seq{ 0 };
+	TelemetryData data;
+};
+
+struct TelemetryFile
+{
+	TelemetrySegment *pSeg = nullptr;	//the mapped segment
+	void *hMapping = nullptr;			//platform handle
+	std::string name;
+	bool owner = false;					//we created it, so we remove it
+
+	//make the segment and start publishing into it, the game does this
+	bool Create(const std::string& segName);
+	//map an existing segment read only, a monitor does this
+	bool Attach(const std::string& segName);
+	void Close();
+	//copy data into the segment, never blocks
+	void Publish(const TelemetryData& data);
+	//a consistent copy of the latest data, false if the writer kept getting in the way
+	bool Sample(TelemetryData& data, int maxTries = 1000) const;
+};
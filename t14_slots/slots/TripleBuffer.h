@@ -0,0 +1,35 @@
+#pragma once
+
+#include <atomic>
+
+/*
+Hand the latest copy of something from one thread to another without locks.
+There are three slots: the writer fills its own back slot then swaps it with
+the middle one, the reader swaps its front slot with the middle one whenever
+something new has arrived. Neither side ever waits, the writer can run faster
+or slower than the reader and the reader always gets the most recent copy.
+Only one writer thread and one reader thread.
+*/
+template<class T>
+struct TripleBuffer
+{
+	T slots[3];
+	std::atomic<int> middle{ 1 };	//slot index, plus NEW_DATA if the writer has put something there
+	int back = 0;					//writer's slot
+	int front = 2;					//reader's slot
+	static const int NEW_DATA = 4;
+
+	//writer: fill this in then call Publish
+	T& Back() {
+		return slots[back];
+	}
+	void Publish() {
+		back = middle.exchange(back | NEW_DATA, std::memory_order_acq_rel) & ~NEW_DATA;
+	}
+	//reader: the most recent copy published, stays valid until the next Read
+	const T& Read() {
+		if (middle.load(std::memory_order_relaxed) & NEW_DATA)
+			front = middle.exchange(front, std::memory_order_acq_rel) & ~NEW_DATA;
+		return slots[front];
+	}
+};
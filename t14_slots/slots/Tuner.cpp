@@ -0,0 +1,212 @@
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <thread>
+
+#include "Log.h"
+#include "Tuner.h"
+
+using namespace std;
+
+//prizes, nudge cost, hold cost, then number of nudge/holds
+static const int NUM_PARAMS = GC::NUM_FRUIT + 3;
+typedef array<double, NUM_PARAMS> Point;
+
+//keep the search to something you could put on a cabinet
+static const int MAX_PRIZE = 1000000;
+static const int MAX_COST = 1000;
+static const int MAX_NUDGEHOLD = 20;
+
+//stop when every corner of the simplex scores within this of the best
+static const double SCORE_TOLERANCE = 1e-6;
+
+
+//prizes and costs are searched as logs so a step is a percentage change, the counter is searched as it is
+static Paytable ToPaytable(const Point& x, const Paytable& base)
+{
+	Paytable table = base;
+	for (int i = 0; i < GC::NUM_FRUIT; ++i)
+		table.prizes[i] = (int)min<double>(max(1.0, round(exp(x[i]))), MAX_PRIZE);
+	table.nudgeCost = (int)min<double>(max(1.0, round(exp(x[GC::NUM_FRUIT]))), MAX_COST);
+	table.holdCost = (int)min<double>(max(1.0, round(exp(x[GC::NUM_FRUIT + 1]))), MAX_COST);
+	table.maxNudgeHold = (int)min<double>(max(0.0, round(x[GC::NUM_FRUIT + 2])), MAX_NUDGEHOLD);
+	return table;
+}
+
+static Point FromPaytable(const Paytable& table)
+{
+	Point x;
+	for (int i = 0; i < GC::NUM_FRUIT; ++i)
+		x[i] = log((double)max(1, table.prizes[i]));
+	x[GC::NUM_FRUIT] = log((double)max(1, table.nudgeCost));
+	x[GC::NUM_FRUIT + 1] = log((double)max(1, table.holdCost));
+	x[GC::NUM_FRUIT + 2] = table.maxNudgeHold;
+	return x;
+}
+
+//a + (b - a) * t
+static Point Lerp(const Point& a, const Point& b, double t)
+{
+	Point r;
+	for (int i = 0; i < NUM_PARAMS; ++i)
+		r[i] = a[i] + (b[i] - a[i]) * t;
+	return r;
+}
+
+//relative misses squared, so the two targets count the same whatever their size
+static double Score(const TuneTarget& target, double rtp, double volatility)
+{
+	double r = (rtp - target.rtp) / target.rtp;
+	double v = (volatility - target.volatility) / target.volatility;
+	return r * r + v * v;
+}
+
+//*************************************************
+
+PaytableEvaluator::Key PaytableEvaluator::MakeKey(const Paytable& table)
+{
+	Key key(table.prizes, table.prizes + GC::NUM_FRUIT);
+	key.insert(key.end(), { table.playCost, table.nudgeCost, table.holdCost, table.maxNudgeHold, table.startCash });
+	return key;
+}
+
+vector<TuneResult> PaytableEvaluator::Evaluate(const vector<Paytable>& tables)
+{
+	//which ones are new? don't simulate the same one twice in a batch either
+	vector<Key> keys;
+	vector<size_t> todo;
+	{
+		lock_guard<mutex> lock(mtx);
+		for (size_t i = 0; i < tables.size(); ++i)
+		{
+			keys.push_back(MakeKey(tables[i]));
+			if (cache.count(keys.back()) || find(keys.begin(), keys.end() - 1, keys.back()) != keys.end() - 1)
+				++numCached;
+			else
+				todo.push_back(i);
+		}
+	}
+
+	//share the cores out between them, RunSessions gives the same answer however many threads it gets
+	if (!todo.empty())
+	{
+		int cores = max(1u, thread::hardware_concurrency());
+		int perTable = max(1, cores / (int)todo.size());
+		auto work = [&](size_t i) {
+			TuneResult result;
+			result.table = tables[i];
+			SessionStats stats = RunSessions(tables[i], target.policy, target.sessions, target.maxSpins, target.seed, perTable);
+			result.rtp = stats.RTP();
+			result.volatility = stats.Volatility(tables[i]);
+			result.score = Score(target, result.rtp, result.volatility);
+			lock_guard<mutex> lock(mtx);
+			cache[keys[i]] = result;
+			++numSimulated;
+		};
+		vector<thread> threads;
+		for (size_t t = 1; t < todo.size(); ++t)
+			threads.emplace_back(work, todo[t]);
+		work(todo[0]);
+		for (thread& t : threads)
+			t.join();
+	}
+
+	vector<TuneResult> results;
+	lock_guard<mutex> lock(mtx);
+	for (const Key& key : keys)
+		results.push_back(cache[key]);
+	return results;
+}
+
+//*************************************************
+
+TuneResult TunePaytable(const Paytable& start, const TuneTarget& target)
+{
+	PaytableEvaluator evaluator(target);
+	struct Vertex {
+		Point x;
+		TuneResult result;
+	};
+
+	//starting simplex: the current paytable plus a nudge along each parameter
+	vector<Vertex> simplex(NUM_PARAMS + 1);
+	simplex[0].x = FromPaytable(start);
+	for (int i = 0; i < NUM_PARAMS; ++i)
+	{
+		simplex[i + 1].x = simplex[0].x;
+		simplex[i + 1].x[i] += (i < GC::NUM_FRUIT + 2) ? 0.5 : 3;	//+65% or +3 goes
+	}
+	auto evaluate = [&](vector<Vertex*> vs) {
+		vector<Paytable> tables;
+		for (Vertex* v : vs)
+			tables.push_back(ToPaytable(v->x, start));
+		vector<TuneResult> results = evaluator.Evaluate(tables);
+		for (size_t i = 0; i < vs.size(); ++i)
+			vs[i]->result = results[i];
+	};
+	vector<Vertex*> all;
+	for (Vertex& v : simplex)
+		all.push_back(&v);
+	evaluate(all);
+
+	double lastBest = -1;
+	int stalled = 0;		//steps in a row where every point came out of the cache
+	while (evaluator.NumSimulated() < target.maxEvals && stalled < 2 * NUM_PARAMS)
+	{
+		int simulated = evaluator.NumSimulated();
+		sort(simplex.begin(), simplex.end(), [](const Vertex& a, const Vertex& b) { return a.result.score < b.result.score; });
+		const Vertex& best = simplex.front();
+		Vertex& worst = simplex.back();
+		if (best.result.score != lastBest)
+		{
+			lastBest = best.result.score;
+			LOG_INFO("tune: {} simulated, best rtp {} volatility {} score {}", evaluator.NumSimulated(),
+				best.result.rtp, best.result.volatility, best.result.score);
+		}
+		if (simplex.back().result.score - best.result.score < SCORE_TOLERANCE)
+			break;
+
+		Point centroid = {};
+		for (int i = 0; i < NUM_PARAMS; ++i)
+			for (int j = 0; j < NUM_PARAMS; ++j)
+				centroid[j] += simplex[i].x[j] / NUM_PARAMS;
+
+		//work out every point this step might want and simulate them together
+		Vertex reflect, expand, outside, inside;
+		reflect.x = Lerp(centroid, worst.x, -1);
+		expand.x = Lerp(centroid, worst.x, -2);
+		outside.x = Lerp(centroid, worst.x, -0.5);
+		inside.x = Lerp(centroid, worst.x, 0.5);
+		evaluate({ &reflect, &expand, &outside, &inside });
+
+		const double r = reflect.result.score;
+		if (r < best.result.score)
+			worst = (expand.result.score < r) ? expand : reflect;
+		else if (r < simplex[NUM_PARAMS - 1].result.score)
+			worst = reflect;
+		else if (r < worst.result.score && outside.result.score <= r)
+			worst = outside;
+		else if (r >= worst.result.score && inside.result.score < worst.result.score)
+			worst = inside;
+		else
+		{
+			//nothing helped, pull everything in towards the best
+			vector<Vertex*> shrunk;
+			for (size_t i = 1; i < simplex.size(); ++i)
+			{
+				simplex[i].x = Lerp(simplex[0].x, simplex[i].x, 0.5);
+				shrunk.push_back(&simplex[i]);
+			}
+			evaluate(shrunk);
+		}
+		//the points round to paytables we've already tried, the simplex has shrunk to nothing
+		stalled = (evaluator.NumSimulated() == simulated) ? stalled + 1 : 0;
+	}
+
+	TuneResult best = simplex.front().result;
+	for (const Vertex& v : simplex)
+		if (v.result.score < best.score)
+			best = v.result;
+	LOG_INFO("tune: done after {} simulated, {} from the cache", evaluator.NumSimulated(), evaluator.NumCached());
+	return best;
+}
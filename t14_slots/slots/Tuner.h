@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include "Sim.h"
+
+/*
+Searches for a paytable (prizes, nudge and hold costs, how many nudge/holds)
+that gives a target return to player and volatility, instead of changing
+GameRules.h and playing it by hand. Nelder-Mead does the searching as it
+doesn't need gradients, the simulator is far too noisy for those anyway.
+*/
+
+//what we're aiming for and how hard to look
+struct TuneTarget {
+	double rtp = 0.92;				//0.92 = 92% paid back
+	double volatility = 10;			//stddev of one spin's payout, in spins
+	Policy policy = Policy::GREEDY;	//who we expect to be playing
+	uint64_t sessions = 200000;		//per paytable tried
+	int maxSpins = 200;
+	uint64_t seed = 1;
+	int maxEvals = 300;				//give up after simulating this many paytables
+};
+
+//how one paytable did
+struct TuneResult {
+	Paytable table;
+	double rtp = 0;
+	double volatility = 0;
+	double score = 0;				//0 is spot on, smaller is better
+};
+
+/*
+Every paytable is simulated with the same seed and session count, so they all
+see the same random numbers (common random numbers) and the differences
+between them are down to the paytable, not luck. That also means a paytable
+we've seen before gives the same answer, so results are cached.
+*/
+class PaytableEvaluator
+{
+public:
+	explicit PaytableEvaluator(const TuneTarget& target) : target(target) {}
+	//simulate any we haven't seen yet, several at once, and return them all in order
+	std::vector<TuneResult> Evaluate(const std::vector<Paytable>& tables);
+	int NumSimulated() const { return numSimulated; }
+	int NumCached() const { return numCached; }
+
+private:
+	typedef std::vector<int> Key;
+	static Key MakeKey(const Paytable& table);
+
+	TuneTarget target;
+	std::mutex mtx;
+	std::map<Key, TuneResult> cache;
+	int numSimulated = 0;
+	int numCached = 0;
+};
+
+//start from a paytable and return the best one found
+TuneResult TunePaytable(const Paytable& start, const TuneTarget& target);
@@ -1,50 +1,86 @@
-#include <assert.h>
-#include <Windows.h>
-#include <time.h>
-
-#include "Utils.h"
-
-using namespace std;
-
-static float clockSecs = 0;
-
-void DebugPrint(const string& mssg1, const string& mssg2)
-{
-	OutputDebugString(mssg1.c_str());
-	OutputDebugString("\n");
-	if (!mssg2.empty()) {
-		OutputDebugString(mssg2.c_str());
-		OutputDebugString("\n");
-	}
-}
-
-void Rnd::Seed(int val)
-{
-	if (val == -1)
-		srand(static_cast<unsigned int>(time(NULL)));
-	else
-		srand(val);
-}
-
-int Rnd::GetRange(int min, int max)
-{
-	return (int)round( GetRange((float)min, (float)max) );
-}
-
-float Rnd::GetRange(float min, float max)
-{
-	assert(min < max);
-	float alpha = (float)(rand()%RAND_MAX)/RAND_MAX;
-	return min + (max - min)*alpha;
-}
-
-float GetClock()
-{
-	return clockSecs;
-}
-
-void AddSecsToClock(float secs)
-{
-	clockSecs += secs;
-}
-
+#include <assert.h>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <time.h>
+#ifdef _WIN32
+#include <Windows.h>
+#endif
+
+#include "Log.h"
+#include "Utils.h"
+
+using namespace std;
+
+static float clockSecs = 0;
+
+void DebugPrint(const string& mssg1, const string& mssg2)
+{
+	//the log thread sends it to the debug output window as well as the log file
+	LOG_INFO("{}{}", mssg1, mssg2);
+}
+
+void UseParentConsole()
+{
+#ifdef _WIN32
+	if (AttachConsole(ATTACH_PARENT_PROCESS)) {
+		FILE *pDummy;
+		freopen_s(&pDummy, "CONOUT$", "w", stdout);
+		freopen_s(&pDummy, "CONOUT$", "w", stderr);
+	}
+#endif
+}
+
+RndStream Rnd::stream;
+
+void Rnd::Seed(int val)
+{
+	if (val == -1)
+		stream = RndStream((uint64_t)time(NULL) ^ ((uint64_t)clock() << 32));
+	else
+		stream = RndStream((uint64_t)val);
+}
+
+int Rnd::GetRange(int min, int max)
+{
+	return stream.GetRange(min, max);
+}
+
+float Rnd::GetRange(float min, float max)
+{
+	assert(min < max);
+	return stream.GetRange(min, max);
+}
+
+int RndStream::GetRange(int min, int max)
+{
+	assert(min <= max);
+	const uint64_t range = (uint64_t)((int64_t)max - min) + 1;
+	if (range > 0xffffffffull)
+		return (int)((int64_t)min + (uint32_t)(Next() >> 32));
+	/*
+	n % range on its own favours the low numbers a little. Instead scale a
+	32 bit number up by range and take the top half, throwing away the few
+	numbers that would make one outcome likelier than another (Lemire's
+	method). The division to find them only happens when we're close.
+	*/
+	const uint32_t r = (uint32_t)range;
+	uint64_t m = (Next() >> 32) * r;
+	if ((uint32_t)m < r) {
+		const uint32_t threshold = (0u - r) % r;
+		while ((uint32_t)m < threshold)
+			m = (Next() >> 32) * r;
+	}
+	return (int)((int64_t)min + (int64_t)(m >> 32));
+}
+
+float GetClock()
+{
+	return clockSecs;
+}
+
+void AddSecsToClock(float secs)
+{
+	clockSecs += secs;
+}
+
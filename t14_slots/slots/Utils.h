@@ -1,21 +1,57 @@
-#pragma once
-#include <string>
-
-
-
-/*
-Send text to the debug output window
-Second parameter can be ignored
-*/
-void DebugPrint(const std::string& mssg1, const std::string& mssg2 = "");
-
-//seed and generate random numbers
-struct Rnd
-{
-	static void Seed(int val = -1);
-	static int GetRange(int min, int max);
-	static float GetRange(float min, float max);
-};
-
-float GetClock();
-void AddSecsToClock(float secs);
+#pragma once
+#include <cstdint>
+#include <string>
+
+
+
+/*
+Send text to the log (and the debug output window)
+Second parameter can be ignored
+*/
+void DebugPrint(const std::string& mssg1, const std::string& mssg2 = "");
+
+/*
+We're a windowed program so printf goes nowhere, if we were started
+from a command prompt send stdout/stderr back to it
+*/
+void UseParentConsole();
+
+/*
+A random number stream of our own. The simulators give every thread one so
+they don't share state, and Rnd keeps one for the game, so simulations and
+fairness tests exercise exactly what the cabinet runs.
+*/
+struct RndStream
+{
+	uint64_t state;
+
+	explicit RndStream(uint64_t seed = 0) : state(seed) {}
+	//splitmix64, every seed gives a good independent looking sequence
+	uint64_t Next() {
+		uint64_t z = (state += 0x9e3779b97f4a7c15ull);
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+		return z ^ (z >> 31);
+	}
+	//0 <= alpha < 1
+	float GetAlpha() {
+		return (Next() >> 40) * (1.f / 16777216.f);
+	}
+	//min <= n <= max, every value exactly as likely as the others
+	int GetRange(int min, int max);
+	float GetRange(float min, float max) {
+		return min + (max - min) * GetAlpha();
+	}
+};
+
+//seed and generate random numbers, for the game thread
+struct Rnd
+{
+	static void Seed(int val = -1);
+	static int GetRange(int min, int max);
+	static float GetRange(float min, float max);
+	static RndStream stream;
+};
+
+float GetClock();
+void AddSecsToClock(float secs);
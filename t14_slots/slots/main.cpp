@@ -1,751 +1,1400 @@
-#include <assert.h>
-#include <sstream>
-
-#include "SFML/Graphics.hpp"
-#include "SFML/Audio.hpp"
-#include "Utils.h"
-#include "MyDB.h"
-
-using namespace sf;
-using namespace std;
-
-//*************************************************
-//game constants
-namespace GC {
-	const char ESCAPE_KEY = 27;
-	const char BACKSPACE_KEY = 8;
-	const char ENTER_KEY = 13;
-	const char ZERO_KEY = 48;
-	const vector<IntRect> SPR_DIMS = {	//image coordinates for the fruit
-		{0, 0,   94, 94},
-		{0, 94,  94, 94},
-		{0, 188, 94, 94},
-		{0, 282, 94, 94},
-		{0, 376, 94, 94},
-		{0, 470, 94, 94}
-	};
-	const vector<IntRect> SPR_DIMS_SPIN = { //image coordinates when the fruit spin
-		{94, 0,   94, 94},
-		{94, 94,  94, 94},
-		{94, 188, 94, 94},
-		{94, 282, 94, 94},
-		{94, 376, 94, 94},
-		{94, 470, 94, 94}
-	};
-	const vector<string> SPR_NAMES = { //fruit names
-		"orange",
-		"seven",
-		"bar",
-		"pear", 
-		"banana",
-		"cherry"
-	};
-	const IntRect HOLD_DIMS = {188,0,78,29}; //a "hold" image
-	const vector<int> CASH_PRIZES = { 15, 20, 30, 50, 100, 250 };	//how much a win is worth for each fruit
-	const int NUDGE_COST = 5;		//cost to nudge
-	const int HOLD_COST = 6;		//cost to hold
-	const int PLAY_COST = 5;		//cost to play
-	const int START_CASH = 200;		//starting pot
-	const int MAX_NUDGEHOLD = 10;	//how many times you can hold and nudge before you have to spin again
-	const float SPIN_TIME = 2.f;	//how long a full spin is meant to last	
-	const int MAX_NAME = 8;			//max characters in player name
-	const int MAX_HIGHSCORES = 10;	//only save and show 10 of them
-}
-
-//*************************************************
-//handles the 5 reels of the slot machine, spinning them around
-//instructions for the slots
-struct Slots
-{
-	//there are five reels
-	struct Data {
-		int result=0;		//what it current shows, matches fruit order on sprite sheet
-		float spinTime=0;	//how long this reel has left to spin
-		bool hold = false;	//is this reel meant to be holding
-	};
-	vector<Data> reels;
-
-	Texture texIcons;			//all fruit sprites on one texture
-	bool spinning = false;		//are we spinning right now?
-	float spinTimer = 0;		//how long to spin
-	bool winningRound = false;	//did we just win a prize - all fruit same on one line
-	int nudgeHoldCtr = GC::MAX_NUDGEHOLD;	//how many times have we left to nudge or hold?
-
-	//set everything up
-	void Init();
-	//setup the reels teh first time
-	void Reset();
-	//spin one or more reels
-	void Spin();
-	//render and update the reels
-	void Render(RenderWindow& window, float elapsed, Font& font);
-	void Update(RenderWindow& window, float elapsed);
-	//how much did we win on the last spin?
-	int GetWinnings();
-	//nudge a specific real (0-5), makes just that reel spin
-	void Nudge(int reel);
-	//hold a specific reel (0-5), makes all reels spin other than this one
-	void Hold(int reel);
-	//show what a line of fruit is worth
-	void RenderInstructions(RenderWindow& window, Font& font);
-	//can we nudge or hold anymore of have we ran out of goes and need to spin?
-	bool CanNudgeAndHold() {
-		return nudgeHoldCtr > 0;
-	}
-};
-
-void Slots::Nudge(int reel)
-{
-	assert(nudgeHoldCtr > 0);
-	--nudgeHoldCtr;
-	winningRound = false;
-	spinning = true;
-	spinTimer = GetClock() + (GC::SPIN_TIME/5); //time to spin just one reel
-	//ensure all reels will not spin
-	for (size_t i = 0; i < reels.size(); ++i)
-		reels[i].spinTime = 0; 
-	//let the one we are interested in spin
-	reels[reel].spinTime = GetClock() + (GC::SPIN_TIME / 5);
-	reels[reel].hold = false;
-}
-
-void Slots::Hold(int reel)
-{
-	assert(nudgeHoldCtr > 0);
-	--nudgeHoldCtr;
-	winningRound = false;
-	spinning = true;
-	spinTimer = GetClock() + (GC::SPIN_TIME * 0.8f); //time to spin 4 of the reels
-	for (int i = 0; i < 5; ++i)
-		if (i != reel)
-		{
-			//if we aren't holding it, set up to sping
-			reels[i].spinTime = GetClock() + (GC::SPIN_TIME / (5 - i));
-			reels[i].hold = false;
-		}
-		else
-			//hold just this one
-			reels[i].hold = true;
-}
-
-int Slots::GetWinnings()
-{
-	//don't call this unless you know we won or it will assert
-	assert(winningRound && reels[0].result>=0 && reels[0].result<=5);
-	return GC::CASH_PRIZES[reels[0].result]; //figure out what a line is worth
-}
-
-void Slots::Init()
-{
-	if (!texIcons.loadFromFile("data/slots.png"))
-		assert(false);
-	Reset();
-}
-
-void Slots::Update(RenderWindow& window, float elapsed)
-{
-	if (spinning)
-	{
-		//as each reel finishes spinning, set it to a random fruit
-		for (size_t i = 0; i < reels.size(); ++i)
-			if (reels[i].spinTime < GetClock() && reels[i].spinTime>0)
-			{
-				reels[i].spinTime = 0;
-				reels[i].result = Rnd::GetRange(0, 5);
-			}
-		//have all reels stopped yet?
-		if (spinTimer < GetClock())
-		{
-			spinning = false;
-			int win = reels[0].result, cnt = 1;
-			for (size_t i = 1; i < reels.size(); ++i)
-			{
-				reels[i].hold = false;		//reset each reel
-				if (reels[i].result == win)	//keep a tally of matching fruit, maybe we won?
-					++cnt;
-			}
-			winningRound = (cnt == (int)reels.size()) ? true : false; //check if we won, it's a one line if statement
-		}
-	}
-}
-
-void Slots::RenderInstructions(RenderWindow& window, Font& font)
-{
-	//print out all the fruit and what they are worth
-	Sprite spr(texIcons);
-	Vector2f off{ 10, 10 };
-	for (size_t i = 0; i < 6; ++i)
-	{
-		spr.setTextureRect(GC::SPR_DIMS[i]);
-		spr.setPosition(off);
-		spr.setScale(0.3f, 0.3f);
-		window.draw(spr);
-
-		stringstream ss;
-		ss << GC::SPR_NAMES[i] << " $" << GC::CASH_PRIZES[i];
-		Text txt(ss.str(), font, 20);
-		txt.setPosition(off.x + spr.getGlobalBounds().width * 1.1f, off.y);
-		window.draw(txt);
-
-		off.y += spr.getGlobalBounds().height * 1.1f;
-	}
-	//keep a tally of how many nudges/holds they've had this spin
-	stringstream ss;
-	ss << "Nudges and holds left: " << nudgeHoldCtr;
-	Text txt(ss.str(), font, 20);
-	txt.setPosition(off);
-	window.draw(txt);
-}
-
-void Slots::Render(RenderWindow& window, float elapsed, Font& font)
-{
-	RenderInstructions(window, font);
-	Vector2f off{ window.getSize().x * 0.3f, window.getSize().y * 0.3f };
-	Sprite spr(texIcons);
-	Text txt("1", font, 30);
-	//render each of the 5 reels
-	for (size_t i = 0; i < reels.size(); ++i)
-	{
-		spr.setPosition(off);
-		//is is spinning or steady?
-		if (spinning && reels[i].spinTime > GetClock())
-			spr.setTextureRect(GC::SPR_DIMS_SPIN[reels[i].result]);
-		else
-			spr.setTextureRect(GC::SPR_DIMS[reels[i].result]);
-		window.draw(spr);
-
-		//is this reel on hold?
-		if (spinning && reels[i].hold)
-		{
-			Sprite spr2(texIcons, GC::HOLD_DIMS);
-			spr2.setPosition(off.x, off.y + GC::HOLD_DIMS.height*1.1f);
-			window.draw(spr2);
-		}
-		//each reel has a number so we can nudge/hold it
-		txt.setString(std::to_string(i + 1));
-		txt.setPosition(off.x + spr.getGlobalBounds().width / 2.f - txt.getGlobalBounds().width/2.f, off.y + spr.getGlobalBounds().height*1.1f);
-		window.draw(txt);
-		off.x += spr.getGlobalBounds().width * 1.1f;
-	}
-}
-
-void Slots::Reset()
-{
-	reels = { {0,0,false},{0,0,false},{0,0,false},{0,0,false},{0,0,false} };
-}
-
-void Slots::Spin()
-{
-	//get everything ready for a new spin
-	nudgeHoldCtr = GC::MAX_NUDGEHOLD;	//reset the nudge/hold counter
-	winningRound = false;
-	spinning = true;
-	spinTimer = GetClock() + GC::SPIN_TIME;
-	//spin every reel
-	for (int i = 0; i < 5; ++i)
-	{
-		reels[i].hold = false;
-		reels[i].spinTime = GetClock() + (GC::SPIN_TIME / (5 - i));
-	}
-}
-
-//*************************************************
-//a slot machine game - take their money, get their name, record how much they win or lose
-struct Game
-{
-	sf::Font font;	//one font for the game
-	MyDB myDB;		//store the high score data
-	Slots slots;	//spin those reels
-	enum class Mode { 
-		READY,			//waiting to see if you want to spin
-		SPINNING,		//away we go
-		RESULT,			//show you the result of a spin
-		ENTER_NAME,		//wait for you to enter your name
-		HIGH_SCORES,	//show you the high scores
-		NUDGE,			//you want to nudge one reel
-		HOLD			//you want to hold one reel	
-	};
-	Mode mode = Mode::READY;
-
-	int cash = 0;						//money in your pot
-	string name;						//who are you
-
-	sf::Music music;
-	sf::Sound sfxWin, sfxLose, sfxSpin;
-	sf::SoundBuffer bufWin, bufLose, bufSpin;
-
-	//set everything up at the start
-	void Initialise(RenderWindow& window);
-	//once at the end, make sure things are shut down, save the database
-	void Release();
-	//standard update and render
-	void Update(RenderWindow& window, float elapsed, char key, bool keyPress, int& nudge);
-	void Render(RenderWindow& window, float elapsed);
-
-	//specialised versions of update
-	void UpdateReady(RenderWindow& window, float elapsed, char key, bool keyPress);
-	void UpdateSpin(RenderWindow& window, float elapsed, char key, bool keyPress);
-	void UpdateResult(RenderWindow& window, float elapsed, char key, bool keyPress);
-	void UpdateHoldNudge(RenderWindow& window, float elapsed, char key, bool keyPress);
-	void UpdateEnterName(RenderWindow& window, float elapsed, char key, bool keyPress, int nudge);
-	void UpdateHighscores(RenderWindow& window, float elapsed, char key, bool keyPress);
-
-	//same again for redering
-	void RenderReady(RenderWindow& window, float elapsed);
-	void RenderResult(RenderWindow& window, float elapsed);
-	void RenderHighscores(RenderWindow& window, float elapsed);
-	void RenderName(RenderWindow& window, float elapsed);
-	void RenderNudgeHold(RenderWindow& window, float elapsed);
-};
-
-void Game::Initialise(RenderWindow& window)
-{
-	//check the database is setup
-	bool doesExist;
-	myDB.Init("data/player.db", doesExist);
-	if (!doesExist)
-	{
-		myDB.ExecQuery("CREATE TABLE HIGHSCORES(" \
-			"ID				 INTEGER PRIMARY KEY autoincrement,"\
-			"NAME			TEXT	NOT NULL,"\
-			"SCORE			INT		NOT NULL");
-		myDB.ExecQuery("CREATE TABLE PLAYS(" \
-			"ID				INTEGER PRIMARY KEY autoincrement,"\
-			"HIGHSCORE_ID	INT		NOT NULL,"\
-			"TOTAL_PLAYS	INT		NOT NULL,"\
-			"TOTAL_NUDGES	INT		NOT NULL");
-	}
-	slots.Init();
-	if (!font.loadFromFile("data/fonts/comic.ttf"))
-		assert(false);
-	Rnd::Seed();	//see the random numbers to time so it's always different
-	cash = GC::START_CASH;
-
-	//play some music permanently
-	if (!music.openFromFile("data/music_loop.wav"))
-		assert(false);
-	music.play();
-	music.setLoop(true);
-	music.setVolume(50);
-
-	//prepare some sound effects
-	if (!bufWin.loadFromFile("data/win.wav"))
-		assert(false);
-	sfxWin.setBuffer(bufWin);
-	if (!bufLose.loadFromFile("data/lose.wav"))
-		assert(false);
-	sfxLose.setBuffer(bufLose);
-	if (!bufSpin.loadFromFile("data/spin.wav"))
-		assert(false);
-	sfxSpin.setBuffer(bufSpin);
-	sfxSpin.setLoop(true);
-	sfxSpin.setVolume(15);
-}
-
-void Game::Release()
-{
-	myDB.SaveToDisk();
-	myDB.Close();
-}
-
-void Game::Update(RenderWindow& window, float elapsed, char key, bool keyPress, int& nudge)
-{
-	slots.Update(window, elapsed);
-	switch(mode)
-	{
-	case Mode::READY:
-		UpdateReady(window, elapsed, key, keyPress);
-		break;
-	case Mode::SPINNING:
-		UpdateSpin(window, elapsed, key, keyPress);
-		break;
-	case Mode::RESULT:
-		UpdateResult(window, elapsed, key, keyPress);
-		break;
-	case Mode::NUDGE:
-	case Mode::HOLD:
-		UpdateHoldNudge(window, elapsed, key, keyPress);
-		nudge++;
-		break;
-	case Mode::ENTER_NAME:
-		UpdateEnterName(window, elapsed, key, keyPress, nudge);
-		break;
-	case Mode::HIGH_SCORES:
-		UpdateHighscores(window, elapsed, key, keyPress);
-		break;
-	}
-}
-
-void Game::UpdateHighscores(RenderWindow& window, float elapsed, char key, bool keyPress)
-{
-	//quit
-	if (Keyboard::isKeyPressed(Keyboard::Escape))
-		window.close();
-	//let's have another go, start over
-	if (keyPress && Keyboard::isKeyPressed(Keyboard::Space))
-	{
-		mode = Mode::READY;
-		cash = GC::START_CASH;
-	}
-}
-
-void Game::UpdateEnterName(RenderWindow& window, float elapsed, char key, bool keyPress, int nudge)
-{
-	if (keyPress)
-	{
-		if (key == GC::ENTER_KEY && name.length()>1)//they've finished typing
-		{
-			stringstream ss;
-			ss << "SELECT ID, NAME, SCORE FROM HIGHSCORES ORDER BY SCORE ASC LIMIT " << GC::MAX_HIGHSCORES;
-			myDB.ExecQuery(ss.str());
-			//is this person already in there?
-			size_t idx = 0;
-			while (idx < myDB.results.size() && myDB.GetStr(idx, "NAME") != name)
-			{
-				++idx;
-			}
-			int pot = cash - GC::START_CASH;
-			if (idx < myDB.results.size())
-			{
-				//udpate the existing record
-				int winnings = myDB.GetInt(idx, "SCORE");
-				int highscoreID = myDB.GetInt(idx, "ID");
-				//int onudge = myDB.GetInt(idx, "NUDGETOTAL");
-				winnings += pot;
-				//tnudge += onudge;
-				ss.str("");
-				ss << "UPDATE HIGHSCORES SET SCORE = " << winnings << " WHERE NAME='" + name + "'";
-				myDB.ExecQuery(ss.str());
-
-				ss << "UPDATE plays set total_play = total_plays + 1, total_nudges = " << nudge << " WHERE highscore_id = " + highscoreID;
-				myDB.ExecQuery(ss.str());
-			}
-				myDB.ExecQuery(ss.str());
-			 if (myDB.results.size() < GC::MAX_HIGHSCORES)
-			{
-				//just add it, we don't have enough
-				ss.str("");
-				ss << "INSERT INTO HIGHSCORES (NAME, SCORE) VALUES ('" << name << "'," << pot << ")";
-				myDB.ExecQuery(ss.str());
-
-				ss << "SELECT ID FROM HIGHSCORES order by ID" << GC::MAX_HIGHSCORES;
-				myDB.ExecQuery(ss.str());
-				//is this person already in there?
-				size_t idx = 0;
-				while (idx < myDB.results.size() && myDB.GetStr(idx, "NAME") != name)
-				{
-					++idx;
-				}
-				int highscoreID = myDB.GetInt(idx, "ID");
-				ss << "INSERT INTO plays (highscore_id, total_plays, total_plays) VALUES (" << highscoreID << ",0,0)";
-				myDB.ExecQuery(ss.str());
-
-			}
-			else if (pot > myDB.GetInt(myDB.results.size() - 1, "SCORE"))
-			{
-				//replace the lowest score
-				ss.str("");
-				ss << "DELETE FROM HIGHSCORES WHERE ID=" << myDB.GetInt(myDB.results.size() - 1, "ID");
-				myDB.ExecQuery(ss.str());
-				ss.str("");
-				ss << "INSERT INTO HIGHSCORES (NAME, SCORE) VALUES ('" << name << "'," << pot;
-				myDB.ExecQuery(ss.str());
-			}
-
-			mode = Mode::HIGH_SCORES;
-		}
-		else if ((key == GC::BACKSPACE_KEY) && name.length() > 0)
-			name = name.substr(0, name.length() - 1);  //delete a character
-		else if (isalpha(key) && name.length() < GC::MAX_NAME)
-			name += key;	//add a character
-	}
-}
-
-
-void Game::UpdateHoldNudge(RenderWindow& window, float elapsed, char key, bool keyPress)
-{
-	size_t reel = key - GC::ZERO_KEY; //convert the key press to a number
-	if (reel >= 1 && reel <= GC::SPR_NAMES.size() && cash >= GC::NUDGE_COST) //check it's a good number and we have money
-	{
-		--reel;//turn the key press into an index into the reel array
-		if (mode == Mode::NUDGE)
-		{
-			cash -= GC::NUDGE_COST;
-			slots.Nudge(reel);
-		}
-		else
-		{
-			cash -= GC::HOLD_COST;
-			slots.Hold(reel);
-		}
-		mode = Mode::SPINNING;
-		sfxSpin.play();
-	}
-}
-
-void Game::UpdateResult(RenderWindow& window, float elapsed, char key, bool keyPress)
-{
-	if (Keyboard::isKeyPressed(Keyboard::Space) && cash > GC::PLAY_COST)
-		mode = Mode::READY; //start again
-	if (Keyboard::isKeyPressed(Keyboard::Escape))
-	{
-		mode = Mode::ENTER_NAME; //check who is playing
-		name.clear();
-	}
-	if (!slots.winningRound && slots.CanNudgeAndHold() && cash > GC::HOLD_COST && cash > GC::NUDGE_COST)
-	{	//do they want to nudge/hold and can they afford it
-		if (key == 'n')
-			mode = Mode::NUDGE;
-		if (key == 'h')
-			mode = Mode::HOLD;
-	}
-}
-
-void Game::UpdateReady(RenderWindow& window, float elapsed, char key, bool keyPress)
-{
-	if (Keyboard::isKeyPressed(Keyboard::Space))
-	{
-		//let's play
-		slots.Spin();
-		cash -= GC::PLAY_COST;
-		mode = Mode::SPINNING;
-		sfxSpin.play();
-	}
-	else if (Keyboard::isKeyPressed(Keyboard::Escape))
-	{
-		mode = Mode::HIGH_SCORES;	
-	}
-}
-
-void Game::UpdateSpin(RenderWindow& window, float elapsed, char key, bool keyPress)
-{
-	if (!slots.spinning)
-	{
-		sfxSpin.stop();
-		if (slots.winningRound)
-		{
-			//we won something!!
-			cash += slots.GetWinnings();
-			sfxWin.play();
-		}
-		else
-			sfxLose.play();
-		mode = Mode::RESULT;
-	}
-}
-
-void Game::Render(RenderWindow& window, float elapsed)
-{
-	//title
-	sf::Text txt("Super Slots!!", font, 30);
-	txt.setPosition(window.getSize().x / 2.f - txt.getGlobalBounds().width / 2.f, window.getSize().y*0.05f);
-	window.draw(txt);
-
-	Vector2f pos;
-	switch(mode)
-	{
-	case Mode::READY:
-		RenderReady(window, elapsed);
-		break;
-	case Mode::SPINNING:
-		slots.Render(window, elapsed, font);
-		break;
-	case Mode::RESULT:
-		RenderResult(window, elapsed);
-		break;
-	case Mode::NUDGE:
-	case Mode::HOLD:
-		RenderNudgeHold(window, elapsed);
-		break;
-	case Mode::ENTER_NAME:
-		RenderName(window, elapsed);
-		break;
-	case Mode::HIGH_SCORES:
-		RenderHighscores(window, elapsed);
-		break;
-	}
-
-	//the pot
-	stringstream ss;
-	ss << "Bank $" << cash;
-	txt.setString(ss.str());
-	pos = { window.getSize().x / 2.f - txt.getGlobalBounds().width / 2.f, pos.y = window.getSize().y * 0.7f };
-	txt.setPosition(pos);
-	window.draw(txt);
-}
-
-void Game::RenderNudgeHold(RenderWindow& window, float elapsed)
-{
-	slots.Render(window, elapsed, font);
-	Text txt("Press <1> <2> <3> <4> <5>.", font);
-	Vector2f pos = { window.getSize().x / 2.f - txt.getGlobalBounds().width / 2.f, window.getSize().y * 0.6f };
-	txt.setPosition(pos);
-	window.draw(txt);
-}
-
-void Game::RenderReady(RenderWindow& window, float elapsed)
-{
-	slots.Render(window, elapsed, font);
-	stringstream ss;
-	ss << "$" << GC::PLAY_COST << " to play. Press <space> to spin.";
-	Text txt(ss.str(), font);
-	Vector2f pos = { window.getSize().x / 2.f - txt.getGlobalBounds().width / 2.f, window.getSize().y * 0.6f };
-	txt.setPosition(pos);
-	window.draw(txt);
-}
-
-void Game::RenderResult(RenderWindow& window, float elapsed)
-{
-	slots.Render(window, elapsed, font);
-	//win lose message
-	stringstream ss;
-	if (slots.winningRound)
-		ss << "You won $" << slots.GetWinnings() << " ";
-	else
-		ss << "You lose. ";
-	if (cash > 0)
-		ss << "Press <space> to spin. ";
-	ss << "Press <ESC> to quit.";
-	Text txt(ss.str(), font);
-	Vector2f pos = { window.getSize().x / 2.f - txt.getGlobalBounds().width / 2.f, window.getSize().y * 0.6f };
-	txt.setPosition(pos);
-	window.draw(txt);
-	//can they save it with a nudge/hold?
-	ss.str("");
-	ss << "$" << GC::PLAY_COST << " to play. ";
-	if (!slots.winningRound && slots.CanNudgeAndHold())
-		ss << "Press <n> to nudge a reel $" << GC::NUDGE_COST
-		<< ", press <h> to hold a reel $" << GC::HOLD_COST << ".";
-	txt.setString(ss.str());
-	pos = { window.getSize().x / 2.f - txt.getGlobalBounds().width / 2.f, window.getSize().y*0.65f };
-	txt.setPosition(pos);
-	window.draw(txt);
-}
-
-void Game::RenderName(RenderWindow& window, float elapsed)
-{
-	Text txt("Enter your name", font);
-	Vector2f pos = { window.getSize().x / 2.f - txt.getGlobalBounds().width / 2.f, window.getSize().y * 0.2f };
-	txt.setPosition(pos);
-	window.draw(txt);
-
-	//show name with a flashing cursor
-	stringstream ss;
-	ss << name;
-	if ((int)GetClock() % 2)
-		ss << '_';
-	txt.setString(ss.str());
-	pos = { window.getSize().x * 0.4f, window.getSize().y * 0.4f };
-	txt.setPosition(pos);
-	window.draw(txt);
-
-	//instructions
-	txt.setString("Undo a character <backspace>, when finished <enter>, eight characters max.");
-	pos = { window.getSize().x / 2.f - txt.getGlobalBounds().width / 2.f, window.getSize().y * 0.6f };
-	txt.setPosition(pos);
-	window.draw(txt);
-}
-
-void Game::RenderHighscores(RenderWindow& window, float elapsed)
-{
-	Text txt("Highscores", font);
-	Vector2f pos = { window.getSize().x / 2.f - txt.getGlobalBounds().width / 2.f, window.getSize().y * 0.1f };
-	txt.setPosition(pos);
-	window.draw(txt);
-
-	//get an ordered copy of the score data
-	stringstream ss;
-	ss << "SELECT NAME, SCORE FROM HIGHSCORES ORDER BY SCORE DESC LIMIT " << GC::MAX_HIGHSCORES;
-	myDB.ExecQuery(ss.str());
-	pos = { window.getSize().x * 0.3f, window.getSize().y * 0.2f };
-	for (size_t i = 0; i < GC::MAX_HIGHSCORES; ++i)
-	{
-		//print out each line
-		ss.str("");
-		ss << i + 1 << ".";
-		txt.setString(ss.str());
-		txt.setPosition(pos);
-		window.draw(txt);
-
-		ss.str("");
-		if (myDB.results.size() > i)
-			ss << myDB.GetStr(i, "NAME");
-		else
-			ss << "???";
-		txt.setString(ss.str());
-		txt.setPosition(window.getSize().x * 0.5f, pos.y);
-		window.draw(txt);
-
-		ss.str("");
-		if (myDB.results.size() > i)
-			ss << myDB.GetStr(i, "SCORE");
-		else
-			ss << "???";
-		txt.setString(ss.str());
-		txt.setPosition(window.getSize().x * 0.7f, pos.y);
-		window.draw(txt);
-
-		pos.y += txt.getGlobalBounds().height * 1.2f;
-	}
-	//instructions
-	txt.setString("Press <ESC> to quit, <space> to keep betting.");
-	pos = { window.getSize().x / 2.f - txt.getGlobalBounds().width / 2.f, window.getSize().y * 0.8f };
-	txt.setPosition(pos);
-	window.draw(txt);
-}
-
-
-//*************************************************
-//entry point
-int main()
-{
-	// Create the main window
-	int nudge;
-	nudge = 0;
-	RenderWindow window( VideoMode(1200, 800), "Slots!");
-
-	Game game;
-	game.Initialise(window);
-
-	Clock clock;
-	// Start the game loop 
-	while (window.isOpen())
-	{
-		bool fire = false, keyPress = false;
-		char key = 0;
-		// Process events
-		Event event;
-		while (window.pollEvent(event))
-		{
-			if (event.type == Event::KeyPressed)
-			{
-				keyPress = true;
-			}
-			else if (event.type == Event::TextEntered)
-			{
-				if (event.text.unicode < 128)
-					key = static_cast<char>(event.text.unicode);
-			}
-			else if (event.type == Event::Closed)
-			{
-				window.close();
-			}
-		} 
-
-		// Clear screen
-		window.clear();
-
-		float elapsed = clock.getElapsedTime().asSeconds();
-		clock.restart();
-		
-		game.Update(window, elapsed, key, keyPress, nudge);
-		game.Render(window, elapsed);
-		AddSecsToClock(elapsed);
-		
-		// Update the window
-		window.display();
-	}
-
-	game.Release();
-	return EXIT_SUCCESS;
-}
+#include <assert.h>
+#include <atomic>
+#include <chrono>
+#include <ctime>
+#include <cstring>
+#include <memory>
+#include <thread>
+
+#include "SFML/Graphics.hpp"
+#include "SFML/Audio.hpp"
+#include "Arena.h"
+#include "DBPool.h"
+#include "DBTransfer.h"
+#include "Fairness.h"
+#include "GameRules.h"
+#include "Leaderboard.h"
+#include "Log.h"
+#include "MPMCRing.h"
+#include "OutcomePool.h"
+#include "Shard.h"
+#include "Sim.h"
+#include "Snapshot.h"
+#include "Telemetry.h"
+#include "TripleBuffer.h"
+#include "Tuner.h"
+#include "Utils.h"
+#include "MyDB.h"
+
+using namespace sf;
+using namespace std;
+
+//*************************************************
+//game constants, the ones that decide who wins are in GameRules.h
+namespace GC {
+	const char ESCAPE_KEY = 27;
+	const char BACKSPACE_KEY = 8;
+	const char ENTER_KEY = 13;
+	const char ZERO_KEY = 48;
+	const vector<IntRect> SPR_DIMS = {	//image coordinates for the fruit
+		{0, 0,   94, 94},
+		{0, 94,  94, 94},
+		{0, 188, 94, 94},
+		{0, 282, 94, 94},
+		{0, 376, 94, 94},
+		{0, 470, 94, 94}
+	};
+	const vector<IntRect> SPR_DIMS_SPIN = { //image coordinates when the fruit spin
+		{94, 0,   94, 94},
+		{94, 94,  94, 94},
+		{94, 188, 94, 94},
+		{94, 282, 94, 94},
+		{94, 376, 94, 94},
+		{94, 470, 94, 94}
+	};
+	const vector<string> SPR_NAMES = { //fruit names
+		"orange",
+		"seven",
+		"bar",
+		"pear", 
+		"banana",
+		"cherry"
+	};
+	const IntRect HOLD_DIMS = {188,0,78,29}; //a "hold" image
+	const float SPIN_TIME = 2.f;	//how long a full spin is meant to last	
+	const int MAX_NAME = 8;			//max characters in player name
+	const int MAX_HIGHSCORES = 10;	//only show 10 of them
+	const int MAX_PLAYERS = 100000;	//how many players we remember, the lowest score is dropped after that
+	const bool PROFILE_DB = true;	//time every query, the results are written out on exit
+	const char *const DB_STATS_FILE = "data/dbstats.txt";
+	const char *const LOG_FILE = "data/slots.log";
+	const char *const SNAPSHOT_FILE = "data/machine.snap";	//where we are, so a power cut doesn't lose anything
+	const double FAIRNESS_ALPHA = 1e-4;	//a fairness test fails below this p-value, 11 tests so a fair generator fails 1 run in 900
+	const int OUTCOME_POOL_SIZE = 1024;	//spins rolled ahead of time, 0 to roll each one when it's needed
+	const char *const TELEMETRY_NAME = "slots_telemetry";	//shared memory the floor monitor reads, see --telemetry
+}
+
+//*************************************************
+//a line of text that keeps its sf::Text between frames and only rebuilds it when the words change
+struct Label
+{
+	Text txt;
+	string current;		//what it says right now
+
+	void Init(const Font& font, unsigned size = 30) {
+		txt.setFont(font);
+		txt.setCharacterSize(size);
+	}
+	Text& Set(const char *pTxt) {
+		if (current != pTxt) {
+			current = pTxt;
+			txt.setString(pTxt);
+		}
+		return txt;
+	}
+};
+
+//*************************************************
+//handles the 5 reels of the slot machine, spinning them around
+//instructions for the slots
+struct Slots
+{
+	//there are five reels
+	struct Data {
+		int result=0;		//what it current shows, matches fruit order on sprite sheet
+		float spinTime=0;	//how long this reel has left to spin
+		bool hold = false;	//is this reel meant to be holding
+	};
+	vector<Data> reels;
+
+	Texture texIcons;			//all fruit sprites on one texture
+	bool spinning = false;		//are we spinning right now?
+	float spinTimer = 0;		//how long to spin
+	bool winningRound = false;	//did we just win a prize - all fruit same on one line
+	int nudgeHoldCtr = GC::MAX_NUDGEHOLD;	//how many times have we left to nudge or hold?
+	OutcomePool *pPool = nullptr;	//where spins come from, null to roll them here
+	SpinOutcome dealt;				//what the spinning reels will stop on
+	bool dealtWhole = false;		//every reel spun so dealt's prize is the result
+	Label lblPrizes[6];		//what each fruit is worth
+	Label lblNudgeHold;		//how many nudges/holds are left
+	Label lblReels[5];		//the number under each reel
+
+	//everything the renderer needs to draw the reels, copied out each update
+	struct View {
+		struct Reel {
+			int result;		//fruit showing
+			bool spinning;	//still going round
+			bool hold;		//show the hold sign under it
+		};
+		Reel reels[5];
+		bool winningRound;
+		int winnings;
+		int nudgeHoldCtr;
+	};
+
+	//set everything up
+	void Init(const Font& font);
+	//setup the reels teh first time
+	void Reset();
+	//spin one or more reels
+	void Spin();
+	//render and update the reels
+	void Render(RenderWindow& window, const View& view);
+	void Update(RenderWindow& window, float elapsed);
+	//copy out the state the renderer needs
+	void Snapshot(View& view) const;
+	//how much did we win on the last spin?
+	int GetWinnings();
+	//nudge a specific real (0-5), makes just that reel spin
+	void Nudge(int reel);
+	//hold a specific reel (0-5), makes all reels spin other than this one
+	void Hold(int reel);
+	//show what a line of fruit is worth
+	void RenderInstructions(RenderWindow& window, const View& view);
+	//pick what the reels will land on, whole is true for a full spin
+	void Deal(bool whole);
+	//can we nudge or hold anymore of have we ran out of goes and need to spin?
+	bool CanNudgeAndHold() {
+		return nudgeHoldCtr > 0;
+	}
+};
+
+void Slots::Nudge(int reel)
+{
+	assert(nudgeHoldCtr > 0);
+	--nudgeHoldCtr;
+	winningRound = false;
+	spinning = true;
+	Deal(false);
+	spinTimer = GetClock() + (GC::SPIN_TIME/5); //time to spin just one reel
+	//ensure all reels will not spin
+	for (size_t i = 0; i < reels.size(); ++i)
+		reels[i].spinTime = 0; 
+	//let the one we are interested in spin
+	reels[reel].spinTime = GetClock() + (GC::SPIN_TIME / 5);
+	reels[reel].hold = false;
+}
+
+void Slots::Hold(int reel)
+{
+	assert(nudgeHoldCtr > 0);
+	--nudgeHoldCtr;
+	winningRound = false;
+	spinning = true;
+	Deal(false);
+	spinTimer = GetClock() + (GC::SPIN_TIME * 0.8f); //time to spin 4 of the reels
+	for (int i = 0; i < 5; ++i)
+		if (i != reel)
+		{
+			//if we aren't holding it, set up to sping
+			reels[i].spinTime = GetClock() + (GC::SPIN_TIME / (5 - i));
+			reels[i].hold = false;
+		}
+		else
+			//hold just this one
+			reels[i].hold = true;
+}
+
+int Slots::GetWinnings()
+{
+	//don't call this unless you know we won or it will assert
+	assert(winningRound && reels[0].result>=0 && reels[0].result<=5);
+	if (dealtWhole)
+		return dealt.prize;	//already worked out when it was dealt
+	return GC::CASH_PRIZES[reels[0].result]; //figure out what a line is worth
+}
+
+void Slots::Deal(bool whole)
+{
+	dealt = pPool ? pPool->Take(Rnd::stream) : OutcomePool::Roll(Rnd::stream, Paytable());
+	dealtWhole = whole;
+}
+
+void Slots::Init(const Font& font)
+{
+	if (!texIcons.loadFromFile("data/slots.png"))
+		assert(false);
+	//the labels never change so set them up once
+	for (size_t i = 0; i < 6; ++i)
+	{
+		FrameText ss;
+		ss << GC::SPR_NAMES[i] << " $" << GC::CASH_PRIZES[i];
+		lblPrizes[i].Init(font, 20);
+		lblPrizes[i].Set(ss.c_str());
+	}
+	lblNudgeHold.Init(font, 20);
+	for (int i = 0; i < 5; ++i)
+	{
+		FrameText ss;
+		ss << i + 1;
+		lblReels[i].Init(font, 30);
+		lblReels[i].Set(ss.c_str());
+	}
+	Reset();
+}
+
+void Slots::Update(RenderWindow& window, float elapsed)
+{
+	if (spinning)
+	{
+		//as each reel finishes spinning, set it to a random fruit
+		for (size_t i = 0; i < reels.size(); ++i)
+			if (reels[i].spinTime < GetClock() && reels[i].spinTime>0)
+			{
+				reels[i].spinTime = 0;
+				reels[i].result = dealt.fruit[i];
+			}
+		//have all reels stopped yet?
+		if (spinTimer < GetClock())
+		{
+			spinning = false;
+			int win = reels[0].result, cnt = 1;
+			for (size_t i = 1; i < reels.size(); ++i)
+			{
+				reels[i].hold = false;		//reset each reel
+				if (reels[i].result == win)	//keep a tally of matching fruit, maybe we won?
+					++cnt;
+			}
+			//a full spin was scored when it was dealt, after a nudge or hold some reels are old so check
+			winningRound = dealtWhole ? dealt.lineFruit >= 0 : cnt == (int)reels.size();
+		}
+	}
+}
+
+void Slots::RenderInstructions(RenderWindow& window, const View& view)
+{
+	//print out all the fruit and what they are worth
+	Sprite spr(texIcons);
+	Vector2f off{ 10, 10 };
+	for (size_t i = 0; i < 6; ++i)
+	{
+		spr.setTextureRect(GC::SPR_DIMS[i]);
+		spr.setPosition(off);
+		spr.setScale(0.3f, 0.3f);
+		window.draw(spr);
+
+		Text& txt = lblPrizes[i].txt;
+		txt.setPosition(off.x + spr.getGlobalBounds().width * 1.1f, off.y);
+		window.draw(txt);
+
+		off.y += spr.getGlobalBounds().height * 1.1f;
+	}
+	//keep a tally of how many nudges/holds they've had this spin
+	FrameText ss;
+	ss << "Nudges and holds left: " << view.nudgeHoldCtr;
+	Text& txt = lblNudgeHold.Set(ss.c_str());
+	txt.setPosition(off);
+	window.draw(txt);
+}
+
+void Slots::Render(RenderWindow& window, const View& view)
+{
+	RenderInstructions(window, view);
+	Vector2f off{ window.getSize().x * 0.3f, window.getSize().y * 0.3f };
+	Sprite spr(texIcons);
+	//render each of the 5 reels
+	for (size_t i = 0; i < 5; ++i)
+	{
+		const View::Reel& reel = view.reels[i];
+		spr.setPosition(off);
+		//is is spinning or steady?
+		if (reel.spinning)
+			spr.setTextureRect(GC::SPR_DIMS_SPIN[reel.result]);
+		else
+			spr.setTextureRect(GC::SPR_DIMS[reel.result]);
+		window.draw(spr);
+
+		//is this reel on hold?
+		if (reel.hold)
+		{
+			Sprite spr2(texIcons, GC::HOLD_DIMS);
+			spr2.setPosition(off.x, off.y + GC::HOLD_DIMS.height*1.1f);
+			window.draw(spr2);
+		}
+		//each reel has a number so we can nudge/hold it
+		Text& txt = lblReels[i].txt;
+		txt.setPosition(off.x + spr.getGlobalBounds().width / 2.f - txt.getGlobalBounds().width/2.f, off.y + spr.getGlobalBounds().height*1.1f);
+		window.draw(txt);
+		off.x += spr.getGlobalBounds().width * 1.1f;
+	}
+}
+
+void Slots::Snapshot(View& view) const
+{
+	assert(reels.size() == 5);
+	for (size_t i = 0; i < 5; ++i)
+	{
+		view.reels[i].result = reels[i].result;
+		view.reels[i].spinning = spinning && reels[i].spinTime > GetClock();
+		view.reels[i].hold = spinning && reels[i].hold;
+	}
+	view.winningRound = winningRound;
+	view.winnings = winningRound ? GC::CASH_PRIZES[reels[0].result] : 0;
+	view.nudgeHoldCtr = nudgeHoldCtr;
+}
+
+void Slots::Reset()
+{
+	reels = { {0,0,false},{0,0,false},{0,0,false},{0,0,false},{0,0,false} };
+}
+
+void Slots::Spin()
+{
+	//get everything ready for a new spin
+	nudgeHoldCtr = GC::MAX_NUDGEHOLD;	//reset the nudge/hold counter
+	winningRound = false;
+	spinning = true;
+	Deal(true);
+	spinTimer = GetClock() + GC::SPIN_TIME;
+	//spin every reel
+	for (int i = 0; i < 5; ++i)
+	{
+		reels[i].hold = false;
+		reels[i].spinTime = GetClock() + (GC::SPIN_TIME / (5 - i));
+	}
+}
+
+//*************************************************
+//a slot machine game - take their money, get their name, record how much they win or lose
+struct Game
+{
+	sf::Font font;	//one font for the game
+	MyDB myDB;		//store the high score data
+	Slots slots;	//spin those reels
+	enum class Mode { 
+		READY,			//waiting to see if you want to spin
+		SPINNING,		//away we go
+		RESULT,			//show you the result of a spin
+		ENTER_NAME,		//wait for you to enter your name
+		HIGH_SCORES,	//show you the high scores
+		NUDGE,			//you want to nudge one reel
+		HOLD			//you want to hold one reel	
+	};
+	Mode mode = Mode::READY;
+
+	int cash = 0;						//money in your pot
+	string name;						//who are you
+	int numPlayers = 0;					//how many rows are in HIGHSCORES
+	int nudges = 0;						//frames spent choosing a nudge/hold, goes into PLAYS
+	bool quit = false;					//time to shut down
+	SnapshotFile snapshot;				//saved on every change of state, restored at start up
+	MachineState lastState;				//what we last saved
+	unique_ptr<OutcomePool> pool;		//spins rolled ahead of time, if GC::OUTCOME_POOL_SIZE says so
+	TelemetryFile telemetry;			//live numbers for the floor monitor
+	TelemetryData tele;					//what goes into it, only touched by the update thread
+	atomic<float> frameMs{ 0 };			//frame times from the render thread, published by the update thread
+	atomic<float> frameMsAvg{ 0 };
+	atomic<float> frameMsMax{ 0 };
+
+	//one line of the high score table
+	struct Score {
+		char name[GC::MAX_NAME + 1];
+		int score;
+	};
+	Score scores[GC::MAX_HIGHSCORES];	//the table as it was last read from the database
+	int numScores = 0;
+
+	/*
+	Update and Render run on different threads, the update side copies
+	everything that gets drawn into one of these and hands it over through
+	a triple buffer, so neither side waits on the other
+	*/
+	struct View {
+		Mode mode;
+		int cash;
+		char name[GC::MAX_NAME + 1];
+		float clock;
+		Slots::View slots;
+		Score scores[GC::MAX_HIGHSCORES];
+		int numScores;
+	};
+	TripleBuffer<View> views;
+
+	//text we draw every frame, kept between frames so drawing doesn't allocate
+	Label lblTitle, lblBank, lblHeading, lblAllocs;
+	Label lblMssg[3];
+	Label lblScores[GC::MAX_HIGHSCORES][3];
+	unsigned frameAllocs = 0;			//heap allocations during the last frame
+
+	sf::Music music;
+	sf::Sound sfxWin, sfxLose, sfxSpin;
+	sf::SoundBuffer bufWin, bufLose, bufSpin;
+
+	//set everything up at the start
+	void Initialise(RenderWindow& window);
+	//once at the end, make sure things are shut down, save the database
+	void Release();
+	//add this round's winnings to the player's score and keep the table trimmed
+	void SubmitScore(int nudge);
+	//read the top scores ready to show them
+	void LoadHighscores();
+	//copy the whole machine state in/out of a snapshot
+	void SaveState(MachineState& state) const;
+	void RestoreState(const MachineState& state);
+	//save a snapshot if anything other than the clock has moved on since the last one
+	void SnapshotIfChanged();
+	//count a trip to the database that started at start
+	void AddDBTime(chrono::steady_clock::time_point start);
+	//copy the latest numbers out to the floor monitor
+	void PublishTelemetry();
+	//standard update and render, Update on the main thread, Render on the render thread
+	void Update(RenderWindow& window, float elapsed, char key, bool keyPress);
+	void Render(RenderWindow& window, const View& view);
+	//copy the current state out to the render thread
+	void Publish();
+
+	//specialised versions of update
+	void UpdateReady(RenderWindow& window, float elapsed, char key, bool keyPress);
+	void UpdateSpin(RenderWindow& window, float elapsed, char key, bool keyPress);
+	void UpdateResult(RenderWindow& window, float elapsed, char key, bool keyPress);
+	void UpdateHoldNudge(RenderWindow& window, float elapsed, char key, bool keyPress);
+	void UpdateEnterName(RenderWindow& window, float elapsed, char key, bool keyPress);
+	void UpdateHighscores(RenderWindow& window, float elapsed, char key, bool keyPress);
+
+	//same again for redering
+	void RenderReady(RenderWindow& window, const View& view);
+	void RenderResult(RenderWindow& window, const View& view);
+	void RenderHighscores(RenderWindow& window, const View& view);
+	void RenderName(RenderWindow& window, const View& view);
+	void RenderNudgeHold(RenderWindow& window, const View& view);
+};
+
+void Game::Initialise(RenderWindow& window)
+{
+	//check the database is setup, older files may be missing tables or indices
+	bool doesExist;
+	myDB.Init("data/player.db", doesExist);
+	myDB.profiling = GC::PROFILE_DB;
+	CreatePlayerTables(myDB);
+	myDB.Exec(myDB.Prepare("SELECT COUNT(*) AS NUM FROM HIGHSCORES"));
+	numPlayers = myDB.GetInt(0, "NUM");
+
+	if (!font.loadFromFile("data/fonts/comic.ttf"))
+		assert(false);
+	slots.Init(font);
+	lblTitle.Init(font);
+	lblTitle.Set("Super Slots!!");
+	lblBank.Init(font);
+	lblHeading.Init(font);
+	lblAllocs.Init(font, 14);
+	for (Label& lbl : lblMssg)
+		lbl.Init(font);
+	for (auto& row : lblScores)
+		for (Label& lbl : row)
+			lbl.Init(font);
+	Rnd::Seed();	//see the random numbers to time so it's always different
+	if (GC::OUTCOME_POOL_SIZE > 0)
+	{
+		//one producer keeps up with a cabinet easily, a spin server would want more
+		pool.reset(new OutcomePool(GC::OUTCOME_POOL_SIZE));
+		pool->Start(1);
+		slots.pPool = pool.get();
+	}
+	cash = GC::START_CASH;
+
+	//play some music permanently
+	if (!music.openFromFile("data/music_loop.wav"))
+		assert(false);
+	music.play();
+	music.setLoop(true);
+	music.setVolume(50);
+
+	//prepare some sound effects
+	if (!bufWin.loadFromFile("data/win.wav"))
+		assert(false);
+	sfxWin.setBuffer(bufWin);
+	if (!bufLose.loadFromFile("data/lose.wav"))
+		assert(false);
+	sfxLose.setBuffer(bufLose);
+	if (!bufSpin.loadFromFile("data/spin.wav"))
+		assert(false);
+	sfxSpin.setBuffer(bufSpin);
+	sfxSpin.setLoop(true);
+	sfxSpin.setVolume(15);
+
+	//pick up where we left off if the power went
+	MachineState state;
+	if (snapshot.Open(GC::SNAPSHOT_FILE) && snapshot.Load(state))
+	{
+		RestoreState(state);
+		LOG_INFO("resumed from snapshot {}, mode {} cash {}", (unsigned long long)state.seq, state.mode, state.cash);
+	}
+	SaveState(lastState);
+	telemetry.Create(GC::TELEMETRY_NAME);
+}
+
+void Game::Release()
+{
+	if (pool)
+		pool->Stop();
+	telemetry.Close();
+	snapshot.Close();
+	myDB.SaveToDisk();
+	if (myDB.profiling)
+		myDB.DumpStats(GC::DB_STATS_FILE);
+	myDB.Close();
+}
+
+void Game::Update(RenderWindow& window, float elapsed, char key, bool keyPress)
+{
+	slots.Update(window, elapsed);
+	switch(mode)
+	{
+	case Mode::READY:
+		UpdateReady(window, elapsed, key, keyPress);
+		break;
+	case Mode::SPINNING:
+		UpdateSpin(window, elapsed, key, keyPress);
+		break;
+	case Mode::RESULT:
+		UpdateResult(window, elapsed, key, keyPress);
+		break;
+	case Mode::NUDGE:
+	case Mode::HOLD:
+		UpdateHoldNudge(window, elapsed, key, keyPress);
+		nudges++;
+		break;
+	case Mode::ENTER_NAME:
+		UpdateEnterName(window, elapsed, key, keyPress);
+		break;
+	case Mode::HIGH_SCORES:
+		UpdateHighscores(window, elapsed, key, keyPress);
+		break;
+	}
+	SnapshotIfChanged();
+	PublishTelemetry();
+}
+
+void Game::AddDBTime(chrono::steady_clock::time_point start)
+{
+	float us = chrono::duration<float, micro>(chrono::steady_clock::now() - start).count();
+	tele.dbCalls++;
+	tele.dbTotalUs += (uint64_t)us;
+	tele.dbLastUs = us;
+	tele.dbMaxUs = max(tele.dbMaxUs, us);
+}
+
+void Game::PublishTelemetry()
+{
+	tele.updates++;
+	tele.timeUs = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+	tele.mode = (int32_t)mode;
+	tele.cash = cash;
+	tele.frameMs = frameMs;
+	tele.frameMsAvg = frameMsAvg;
+	tele.frameMsMax = frameMsMax.exchange(0);
+	if (pool)
+	{
+		OutcomePool::Stats stats = pool->GetStats();
+		tele.poolDepth = (uint32_t)stats.depth;
+		tele.poolMisses = stats.misses;
+	}
+	telemetry.Publish(tele);
+}
+
+void Game::SaveState(MachineState& state) const
+{
+	state.mode = (int32_t)mode;
+	state.cash = cash;
+	state.nudges = nudges;
+	state.nudgeHoldCtr = slots.nudgeHoldCtr;
+	state.spinning = slots.spinning;
+	state.winningRound = slots.winningRound;
+	state.spinRemaining = slots.spinning ? slots.spinTimer - GetClock() : 0;
+	state.dealt = slots.dealt;
+	state.dealtWhole = slots.dealtWhole;
+	for (int i = 0; i < MachineState::NUM_REELS; ++i)
+	{
+		const Slots::Data& reel = slots.reels[i];
+		state.reels[i].result = reel.result;
+		state.reels[i].spinRemaining = reel.spinTime > 0 ? max(reel.spinTime - GetClock(), 0.001f) : 0;
+		state.reels[i].hold = reel.hold;
+	}
+	memset(state.name, 0, sizeof(state.name));
+	memcpy(state.name, name.c_str(), min(name.length(), sizeof(state.name) - 1));
+}
+
+void Game::RestoreState(const MachineState& state)
+{
+	mode = (Mode)state.mode;
+	cash = state.cash;
+	nudges = state.nudges;
+	name = state.name;
+	slots.nudgeHoldCtr = state.nudgeHoldCtr;
+	slots.spinning = state.spinning != 0;
+	slots.winningRound = state.winningRound != 0;
+	slots.spinTimer = GetClock() + state.spinRemaining;
+	slots.dealt = state.dealt;
+	slots.dealtWhole = state.dealtWhole != 0;
+	for (int i = 0; i < MachineState::NUM_REELS; ++i)
+	{
+		Slots::Data& reel = slots.reels[i];
+		reel.result = state.reels[i].result;
+		reel.spinTime = state.reels[i].spinRemaining > 0 ? GetClock() + state.reels[i].spinRemaining : 0;
+		reel.hold = state.reels[i].hold != 0;
+	}
+	if (mode == Mode::HIGH_SCORES)
+		LoadHighscores();
+	if (mode == Mode::SPINNING)
+		sfxSpin.play();
+}
+
+void Game::SnapshotIfChanged()
+{
+	if (!snapshot.pView)
+		return;
+	MachineState state;
+	SaveState(state);
+	//timers tick every frame, only the things that change on a transition count
+	bool changed = state.mode != lastState.mode || state.cash != lastState.cash
+		|| state.nudgeHoldCtr != lastState.nudgeHoldCtr || state.spinning != lastState.spinning
+		|| state.winningRound != lastState.winningRound || memcmp(state.name, lastState.name, sizeof(state.name)) != 0
+		|| state.dealtWhole != lastState.dealtWhole || state.dealt.prize != lastState.dealt.prize
+		|| state.dealt.lineFruit != lastState.dealt.lineFruit || memcmp(state.dealt.fruit, lastState.dealt.fruit, sizeof(state.dealt.fruit)) != 0;
+	for (int i = 0; i < MachineState::NUM_REELS && !changed; ++i)
+		changed = state.reels[i].result != lastState.reels[i].result || state.reels[i].hold != lastState.reels[i].hold
+			|| (state.reels[i].spinRemaining > 0) != (lastState.reels[i].spinRemaining > 0);
+	if (changed)
+	{
+		snapshot.Save(state);
+		lastState = state;
+	}
+}
+
+void Game::UpdateHighscores(RenderWindow& window, float elapsed, char key, bool keyPress)
+{
+	//quit
+	if (Keyboard::isKeyPressed(Keyboard::Escape))
+		quit = true;
+	//let's have another go, start over
+	if (keyPress && Keyboard::isKeyPressed(Keyboard::Space))
+	{
+		mode = Mode::READY;
+		cash = GC::START_CASH;
+	}
+}
+
+void Game::SubmitScore(int nudge)
+{
+	auto start = chrono::steady_clock::now();
+	int pot = cash - GC::START_CASH;
+	bool ok = myDB.Begin();
+	//ask rather than compare rowids, the last insert rowid is per connection not per table
+	ok = ok && myDB.Exec(myDB.Prepare("SELECT ID FROM HIGHSCORES WHERE NAME = ?1").Bind(1, name));
+	bool isNew = ok && myDB.results.empty();
+	//new players get a row, existing ones add to their score, found via the NAME index
+	ok = ok && myDB.Exec(myDB.Prepare("INSERT INTO HIGHSCORES (NAME, SCORE, SEQ) VALUES (?1, ?2, " NEXT_HIGHSCORE_SEQ ") "\
+		"ON CONFLICT(NAME) DO UPDATE SET SCORE = SCORE + excluded.SCORE, SEQ = excluded.SEQ").Bind(1, name).Bind(2, pot));
+	ok = ok && myDB.Exec(myDB.Prepare("INSERT INTO PLAYS (HIGHSCORE_ID, TOTAL_PLAYS, TOTAL_NUDGES) "\
+		"SELECT ID, 1, ?2 FROM HIGHSCORES WHERE NAME = ?1 "\
+		"ON CONFLICT(HIGHSCORE_ID) DO UPDATE SET TOTAL_PLAYS = TOTAL_PLAYS + 1, TOTAL_NUDGES = TOTAL_NUDGES + excluded.TOTAL_NUDGES").Bind(1, name).Bind(2, nudge));
+	//too many players, drop the lowest one using the SCORE index
+	if (ok && isNew && numPlayers + 1 > GC::MAX_PLAYERS)
+		ok = myDB.Exec(myDB.Prepare("DELETE FROM HIGHSCORES WHERE ID = (SELECT ID FROM HIGHSCORES ORDER BY SCORE ASC, ID ASC LIMIT 1)"));
+	ok = ok && myDB.Commit();
+	if (!ok)
+		myDB.Rollback();
+	else if (isNew && numPlayers < GC::MAX_PLAYERS)
+		++numPlayers;
+	AddDBTime(start);
+}
+
+void Game::LoadHighscores()
+{
+	//walks the SCORE index from the top
+	auto start = chrono::steady_clock::now();
+	myDB.Exec(myDB.Prepare("SELECT NAME, SCORE FROM HIGHSCORES ORDER BY SCORE DESC LIMIT ?1").Bind(1, GC::MAX_HIGHSCORES));
+	AddDBTime(start);
+	numScores = (int)min(myDB.results.size(), (size_t)GC::MAX_HIGHSCORES);
+	for (int i = 0; i < numScores; ++i)
+	{
+		const ArenaString& nm = myDB.GetStr(i, "NAME");
+		size_t len = min(nm.length(), sizeof(scores[i].name) - 1);
+		memcpy(scores[i].name, nm.c_str(), len);
+		scores[i].name[len] = 0;
+		scores[i].score = myDB.GetInt(i, "SCORE");
+	}
+}
+
+void Game::Publish()
+{
+	View& view = views.Back();
+	view.mode = mode;
+	view.cash = cash;
+	size_t len = min(name.length(), sizeof(view.name) - 1);
+	memcpy(view.name, name.c_str(), len);
+	view.name[len] = 0;
+	view.clock = GetClock();
+	slots.Snapshot(view.slots);
+	memcpy(view.scores, scores, sizeof(scores));
+	view.numScores = numScores;
+	views.Publish();
+}
+
+void Game::UpdateEnterName(RenderWindow& window, float elapsed, char key, bool keyPress)
+{
+	if (keyPress)
+	{
+		if (key == GC::ENTER_KEY && name.length()>1)//they've finished typing
+		{
+			SubmitScore(nudges);
+			nudges = 0;
+			LoadHighscores();
+			mode = Mode::HIGH_SCORES;
+		}
+		else if ((key == GC::BACKSPACE_KEY) && name.length() > 0)
+			name = name.substr(0, name.length() - 1);  //delete a character
+		else if (isalpha(key) && name.length() < GC::MAX_NAME)
+			name += key;	//add a character
+	}
+}
+
+
+void Game::UpdateHoldNudge(RenderWindow& window, float elapsed, char key, bool keyPress)
+{
+	size_t reel = key - GC::ZERO_KEY; //convert the key press to a number
+	if (reel >= 1 && reel <= GC::SPR_NAMES.size() && cash >= GC::NUDGE_COST) //check it's a good number and we have money
+	{
+		--reel;//turn the key press into an index into the reel array
+		if (mode == Mode::NUDGE)
+		{
+			cash -= GC::NUDGE_COST;
+			tele.coinIn += GC::NUDGE_COST;
+			slots.Nudge(reel);
+		}
+		else
+		{
+			cash -= GC::HOLD_COST;
+			tele.coinIn += GC::HOLD_COST;
+			slots.Hold(reel);
+		}
+		mode = Mode::SPINNING;
+		sfxSpin.play();
+	}
+}
+
+void Game::UpdateResult(RenderWindow& window, float elapsed, char key, bool keyPress)
+{
+	if (Keyboard::isKeyPressed(Keyboard::Space) && cash > GC::PLAY_COST)
+		mode = Mode::READY; //start again
+	if (Keyboard::isKeyPressed(Keyboard::Escape))
+	{
+		mode = Mode::ENTER_NAME; //check who is playing
+		name.clear();
+	}
+	if (!slots.winningRound && slots.CanNudgeAndHold() && cash > GC::HOLD_COST && cash > GC::NUDGE_COST)
+	{	//do they want to nudge/hold and can they afford it
+		if (key == 'n')
+			mode = Mode::NUDGE;
+		if (key == 'h')
+			mode = Mode::HOLD;
+	}
+}
+
+void Game::UpdateReady(RenderWindow& window, float elapsed, char key, bool keyPress)
+{
+	if (Keyboard::isKeyPressed(Keyboard::Space))
+	{
+		//let's play
+		slots.Spin();
+		cash -= GC::PLAY_COST;
+		tele.spins++;
+		tele.coinIn += GC::PLAY_COST;
+		mode = Mode::SPINNING;
+		sfxSpin.play();
+	}
+	else if (Keyboard::isKeyPressed(Keyboard::Escape))
+	{
+		LoadHighscores();
+		mode = Mode::HIGH_SCORES;	
+	}
+}
+
+void Game::UpdateSpin(RenderWindow& window, float elapsed, char key, bool keyPress)
+{
+	if (!slots.spinning)
+	{
+		sfxSpin.stop();
+		LOG_DEBUG("reels {} {} {} {} {} win {} cash {}", slots.reels[0].result, slots.reels[1].result, slots.reels[2].result,
+			slots.reels[3].result, slots.reels[4].result, slots.winningRound, cash);
+		if (slots.winningRound)
+		{
+			//we won something!!
+			cash += slots.GetWinnings();
+			tele.coinOut += slots.GetWinnings();
+			sfxWin.play();
+		}
+		else
+			sfxLose.play();
+		mode = Mode::RESULT;
+	}
+}
+
+void Game::Render(RenderWindow& window, const View& view)
+{
+	//title
+	Text& title = lblTitle.txt;
+	title.setPosition(window.getSize().x / 2.f - title.getGlobalBounds().width / 2.f, window.getSize().y*0.05f);
+	window.draw(title);
+
+	Vector2f pos;
+	switch(view.mode)
+	{
+	case Mode::READY:
+		RenderReady(window, view);
+		break;
+	case Mode::SPINNING:
+		slots.Render(window, view.slots);
+		break;
+	case Mode::RESULT:
+		RenderResult(window, view);
+		break;
+	case Mode::NUDGE:
+	case Mode::HOLD:
+		RenderNudgeHold(window, view);
+		break;
+	case Mode::ENTER_NAME:
+		RenderName(window, view);
+		break;
+	case Mode::HIGH_SCORES:
+		RenderHighscores(window, view);
+		break;
+	}
+
+	//the pot
+	FrameText ss;
+	ss << "Bank $" << view.cash;
+	Text& txt = lblBank.Set(ss.c_str());
+	pos = { window.getSize().x / 2.f - txt.getGlobalBounds().width / 2.f, pos.y = window.getSize().y * 0.7f };
+	txt.setPosition(pos);
+	window.draw(txt);
+
+#ifdef _DEBUG
+	//should sit at zero once everything has warmed up
+	FrameText allocs;
+	allocs << "heap allocs/frame " << (int)frameAllocs;
+	Text& txtAllocs = lblAllocs.Set(allocs.c_str());
+	txtAllocs.setPosition(window.getSize().x - txtAllocs.getGlobalBounds().width - 10.f, window.getSize().y - 30.f);
+	window.draw(txtAllocs);
+#endif
+}
+
+void Game::RenderNudgeHold(RenderWindow& window, const View& view)
+{
+	slots.Render(window, view.slots);
+	Text& txt = lblMssg[0].Set("Press <1> <2> <3> <4> <5>.");
+	Vector2f pos = { window.getSize().x / 2.f - txt.getGlobalBounds().width / 2.f, window.getSize().y * 0.6f };
+	txt.setPosition(pos);
+	window.draw(txt);
+}
+
+void Game::RenderReady(RenderWindow& window, const View& view)
+{
+	slots.Render(window, view.slots);
+	FrameText ss;
+	ss << "$" << GC::PLAY_COST << " to play. Press <space> to spin.";
+	Text& txt = lblMssg[0].Set(ss.c_str());
+	Vector2f pos = { window.getSize().x / 2.f - txt.getGlobalBounds().width / 2.f, window.getSize().y * 0.6f };
+	txt.setPosition(pos);
+	window.draw(txt);
+}
+
+void Game::RenderResult(RenderWindow& window, const View& view)
+{
+	slots.Render(window, view.slots);
+	//win lose message
+	FrameText ss;
+	if (view.slots.winningRound)
+		ss << "You won $" << view.slots.winnings << " ";
+	else
+		ss << "You lose. ";
+	if (view.cash > 0)
+		ss << "Press <space> to spin. ";
+	ss << "Press <ESC> to quit.";
+	Text& txt = lblMssg[0].Set(ss.c_str());
+	Vector2f pos = { window.getSize().x / 2.f - txt.getGlobalBounds().width / 2.f, window.getSize().y * 0.6f };
+	txt.setPosition(pos);
+	window.draw(txt);
+	//can they save it with a nudge/hold?
+	FrameText ss2;
+	ss2 << "$" << GC::PLAY_COST << " to play. ";
+	if (!view.slots.winningRound && view.slots.nudgeHoldCtr > 0)
+		ss2 << "Press <n> to nudge a reel $" << GC::NUDGE_COST
+		<< ", press <h> to hold a reel $" << GC::HOLD_COST << ".";
+	Text& txt2 = lblMssg[1].Set(ss2.c_str());
+	pos = { window.getSize().x / 2.f - txt2.getGlobalBounds().width / 2.f, window.getSize().y*0.65f };
+	txt2.setPosition(pos);
+	window.draw(txt2);
+}
+
+void Game::RenderName(RenderWindow& window, const View& view)
+{
+	Text& txt = lblHeading.Set("Enter your name");
+	Vector2f pos = { window.getSize().x / 2.f - txt.getGlobalBounds().width / 2.f, window.getSize().y * 0.2f };
+	txt.setPosition(pos);
+	window.draw(txt);
+
+	//show name with a flashing cursor
+	FrameText ss;
+	ss << view.name;
+	if ((int)view.clock % 2)
+		ss << '_';
+	Text& txtName = lblMssg[0].Set(ss.c_str());
+	pos = { window.getSize().x * 0.4f, window.getSize().y * 0.4f };
+	txtName.setPosition(pos);
+	window.draw(txtName);
+
+	//instructions
+	Text& txtHelp = lblMssg[1].Set("Undo a character <backspace>, when finished <enter>, eight characters max.");
+	pos = { window.getSize().x / 2.f - txtHelp.getGlobalBounds().width / 2.f, window.getSize().y * 0.6f };
+	txtHelp.setPosition(pos);
+	window.draw(txtHelp);
+}
+
+void Game::RenderHighscores(RenderWindow& window, const View& view)
+{
+	Text& txt = lblHeading.Set("Highscores");
+	Vector2f pos = { window.getSize().x / 2.f - txt.getGlobalBounds().width / 2.f, window.getSize().y * 0.1f };
+	txt.setPosition(pos);
+	window.draw(txt);
+
+	//the update side read the table for us when it switched to this mode
+	pos = { window.getSize().x * 0.3f, window.getSize().y * 0.2f };
+	for (size_t i = 0; i < GC::MAX_HIGHSCORES; ++i)
+	{
+		//print out each line
+		FrameText ss;
+		ss << i + 1 << ".";
+		Text& txtPos = lblScores[i][0].Set(ss.c_str());
+		txtPos.setPosition(pos);
+		window.draw(txtPos);
+
+		Text& txtName = lblScores[i][1].Set((int)i < view.numScores ? view.scores[i].name : "???");
+		txtName.setPosition(window.getSize().x * 0.5f, pos.y);
+		window.draw(txtName);
+
+		FrameText score;
+		if ((int)i < view.numScores)
+			score << view.scores[i].score;
+		else
+			score << "???";
+		Text& txtScore = lblScores[i][2].Set(score.c_str());
+		txtScore.setPosition(window.getSize().x * 0.7f, pos.y);
+		window.draw(txtScore);
+
+		pos.y += txtScore.getGlobalBounds().height * 1.2f;
+	}
+	//instructions
+	Text& txtHelp = lblMssg[0].Set("Press <ESC> to quit, <space> to keep betting.");
+	pos = { window.getSize().x / 2.f - txtHelp.getGlobalBounds().width / 2.f, window.getSize().y * 0.8f };
+	txtHelp.setPosition(pos);
+	window.draw(txtHelp);
+}
+
+
+//*************************************************
+//draw whatever the update side last published, as fast as the display lets us
+void RenderThread(RenderWindow& window, Game& game, atomic<bool>& running)
+{
+	window.setActive(true);
+	auto last = chrono::steady_clock::now();
+	while (running)
+	{
+		//anything built in the frame arena last time is finished with
+		GetFrameArena().Reset();
+		unsigned allocs = GetHeapAllocCount();
+
+		window.clear();
+		game.Render(window, game.views.Read());
+		window.display();
+		game.frameAllocs = GetHeapAllocCount() - allocs;
+
+		//frame times for telemetry, the average is smoothed over about 60 frames
+		auto now = chrono::steady_clock::now();
+		float ms = chrono::duration<float, milli>(now - last).count();
+		last = now;
+		game.frameMs = ms;
+		game.frameMsAvg = game.frameMsAvg + (ms - game.frameMsAvg) / 60;
+		float worst = game.frameMsMax;
+		while (ms > worst && !game.frameMsMax.compare_exchange_weak(worst, ms))
+			;
+	}
+	window.setActive(false);
+}
+
+//*************************************************
+//command line tools, these run instead of the game when there are arguments
+int RunTool(int argc, char *argv[])
+{
+	UseParentConsole();
+	string cmd = argv[1];
+	if ((cmd == "--export" || cmd == "--import") && argc >= 4)
+	{
+		//slots --export data/player.db players.csv
+		//slots --import data/player.db players.bin
+		TransferFormat fmt = FormatFromFileName(argv[3]);
+		Clock clock;
+		bool complete = true;
+		long long count = (cmd == "--export") ? ExportPlayers(argv[2], argv[3], fmt) : ImportPlayers(argv[2], argv[3], fmt, complete);
+		float secs = clock.getElapsedTime().asSeconds();
+		if (count < 0)
+		{
+			fprintf(stderr, "%s failed\n", cmd.c_str() + 2);
+			return EXIT_FAILURE;
+		}
+		if (!complete)
+		{
+			fprintf(stderr, "import failed partway through, the first %lld players went in\n", count);
+			return EXIT_FAILURE;
+		}
+		printf("%lld players in %.2fs (%.0f/s)\n", count, secs, secs > 0 ? count / secs : 0.f);
+		return EXIT_SUCCESS;
+	}
+	if (cmd == "--merge" && argc >= 4)
+	{
+		//slots --merge floor.db 10 cab1/player.db cab2/player.db ...
+		vector<string> cabinets(argv + 4, argv + argc);
+		long long count = UpdateFloor(argv[2], cabinets);
+		vector<LeaderboardEntry> top;
+		if (count < 0 || !FloorTopK(argv[2], atoi(argv[3]), top))
+		{
+			fprintf(stderr, "merge failed\n");
+			return EXIT_FAILURE;
+		}
+		printf("%lld changed rows from %d cabinets\n", count, (int)cabinets.size());
+		for (size_t i = 0; i < top.size(); ++i)
+			printf("%3d. %-8s %8lld  %s\n", (int)i + 1, top[i].name.c_str(), top[i].score, top[i].cabinet.c_str());
+		return EXIT_SUCCESS;
+	}
+	if (cmd == "--bench-floor" && argc >= 3)
+	{
+		//slots --bench-floor floor.db 8 10
+		//every reader thread asks for the top 10 over and over while one thread keeps posting scores
+		int numReaders = (argc >= 4) ? atoi(argv[3]) : (int)max(1u, thread::hardware_concurrency());
+		float secs = (argc >= 5) ? (float)atof(argv[4]) : 5.f;
+		DBPool pool;
+		if (numReaders < 1 || !OpenFloor(pool, argv[2], numReaders))
+		{
+			fprintf(stderr, "can't open %s\n", argv[2]);
+			return EXIT_FAILURE;
+		}
+		atomic<bool> running(true);
+		atomic<long long> reads(0), writes(0);
+		vector<thread> threads;
+		for (int i = 0; i < numReaders; ++i)
+			threads.emplace_back([&]() {
+				vector<LeaderboardEntry> top;
+				while (running && FloorTopK(pool, 10, top))
+					++reads;
+			});
+		threads.emplace_back([&]() {
+			RndStream rnd(time(nullptr));
+			while (running && PostFloorScore(pool, "bench", "P" + to_string(rnd.Next() % 100000), rnd.Next() % 1000000))
+				++writes;
+		});
+		this_thread::sleep_for(chrono::milliseconds((int)(secs * 1000)));
+		running = false;
+		for (thread& t : threads)
+			t.join();
+		pool.Close();
+		printf("%d readers: %.0f top 10s/s while writing %.0f scores/s\n", numReaders, reads / secs, writes / secs);
+		return EXIT_SUCCESS;
+	}
+	if (cmd == "--telemetry")
+	{
+		//slots --telemetry slots_telemetry 10
+		//print what a running game is publishing, n times a second
+		TelemetryFile seg;
+		string segName = (argc >= 3) ? argv[2] : GC::TELEMETRY_NAME;
+		if (!seg.Attach(segName))
+		{
+			fprintf(stderr, "no telemetry called %s, is the game running?\n", segName.c_str());
+			return EXIT_FAILURE;
+		}
+		int hz = (argc >= 4) ? max(1, atoi(argv[3])) : 2;
+		TelemetryData last, now;
+		seg.Sample(last);
+		printf("%8s %8s %8s %8s %6s %6s %6s %7s %7s %7s %8s %6s %6s\n",
+			"spins", "coin in", "coin out", "rtp%", "mode", "cash", "ups", "frame", "avg", "worst", "db us", "pool", "misses");
+		while (true)
+		{
+			this_thread::sleep_for(chrono::milliseconds(1000 / hz));
+			if (!seg.Sample(now))
+				continue;
+			float secs = (now.timeUs - last.timeUs) / 1e6f;
+			uint64_t dbCalls = now.dbCalls - last.dbCalls;
+			printf("%8llu %8llu %8llu %8.2f %6d %6d %6.0f %7.2f %7.2f %7.2f %8.0f %6u %6llu\n",
+				(unsigned long long)now.spins, (unsigned long long)now.coinIn, (unsigned long long)now.coinOut,
+				now.coinIn ? 100.0 * now.coinOut / now.coinIn : 0.0, now.mode, now.cash,
+				secs > 0 ? (now.updates - last.updates) / secs : 0.f, now.frameMs, now.frameMsAvg, now.frameMsMax,
+				dbCalls ? (double)(now.dbTotalUs - last.dbTotalUs) / dbCalls : (double)now.dbLastUs,
+				now.poolDepth, (unsigned long long)now.poolMisses);
+			last = now;
+		}
+	}
+	if (cmd == "--fairness")
+	{
+		//slots --fairness 4000000000 42
+		//exits with a failure if any test does, so a release build can be gated on it
+		uint64_t outcomes = (argc >= 3) ? strtoull(argv[2], nullptr, 10) : 1000000000ull;
+		uint64_t seed = (argc >= 4) ? strtoull(argv[3], nullptr, 10) : (uint64_t)time(nullptr);
+		Clock clock;
+		FairnessCounters counters = RunFairness(outcomes, seed);
+		float secs = clock.getElapsedTime().asSeconds();
+		printf("%llu outcomes of GetRange(0, %d), seed %llu, %.1fs (%.0fM/s)\n", (unsigned long long)counters.n, GC::NUM_FRUIT - 1,
+			(unsigned long long)seed, secs, secs > 0 ? counters.n / secs / 1e6 : 0.f);
+		return PrintFairness(stdout, FairnessResults(counters), GC::FAIRNESS_ALPHA) ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+	if (cmd == "--ring-test")
+	{
+		//slots --ring-test 3 3 2000000
+		//exits with a failure if a value goes missing or comes out twice
+		int pushers = (argc >= 3) ? max(1, atoi(argv[2])) : 3;
+		int poppers = (argc >= 4) ? max(1, atoi(argv[3])) : 3;
+		uint64_t perPusher = (argc >= 5) ? strtoull(argv[4], nullptr, 10) : 2000000ull;
+		Clock clock;
+		bool ok = StressTestMPMCRing(pushers, poppers, perPusher);
+		printf("%d pushers, %d poppers, %llu values in %.2fs: %s\n", pushers, poppers, (unsigned long long)(pushers * perPusher),
+			clock.getElapsedTime().asSeconds(), ok ? "each came out once" : "FAILED");
+		return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+	if (cmd == "--simulate" && argc >= 3)
+	{
+		//slots --simulate 10000000 greedy 1000 42
+		Policy policy = Policy::GREEDY;
+		if (argc >= 4 && !PolicyFromName(argv[3], policy))
+		{
+			fprintf(stderr, "unknown policy %s, try spin, nudge or greedy\n", argv[3]);
+			return EXIT_FAILURE;
+		}
+		int maxSpins = (argc >= 5) ? atoi(argv[4]) : 1000;
+		uint64_t seed = (argc >= 6) ? strtoull(argv[5], nullptr, 10) : (uint64_t)time(nullptr);
+		Clock clock;
+		Paytable table;
+		SessionStats stats = RunSessions(table, policy, strtoull(argv[2], nullptr, 10), maxSpins, seed);
+		float secs = clock.getElapsedTime().asSeconds();
+		printf("policy %s, max spins %d, seed %llu, %.2fs (%.0f spins/s)\n", PolicyName(policy), maxSpins,
+			(unsigned long long)seed, secs, secs > 0 ? stats.spins / secs : 0.f);
+		stats.Print(stdout);
+		printf("volatility %.2f\n", stats.Volatility(table));
+		return EXIT_SUCCESS;
+	}
+	if (cmd == "--jackpot" && argc >= 3)
+	{
+		//slots --jackpot 1000000 greedy 0.5 42
+		Policy policy = Policy::GREEDY;
+		if (argc >= 4 && !PolicyFromName(argv[3], policy))
+		{
+			fprintf(stderr, "unknown policy %s, try spin, nudge or greedy\n", argv[3]);
+			return EXIT_FAILURE;
+		}
+		double tilt = (argc >= 5) ? atof(argv[4]) : 0.5;
+		if (tilt <= 0 || tilt >= 1)
+		{
+			fprintf(stderr, "tilt is the jackpot fruit's chance per reel, between 0 and 1\n");
+			return EXIT_FAILURE;
+		}
+		uint64_t seed = (argc >= 6) ? strtoull(argv[5], nullptr, 10) : (uint64_t)time(nullptr);
+		Paytable table;
+		Clock clock;
+		JackpotEstimate est = EstimateJackpot(table, policy, strtoull(argv[2], nullptr, 10), tilt, seed);
+		printf("policy %s, seed %llu, %.2fs\n", PolicyName(policy), (unsigned long long)seed, clock.getElapsedTime().asSeconds());
+		est.Print(stdout, table);
+		return EXIT_SUCCESS;
+	}
+	if (cmd == "--tune" && argc >= 4)
+	{
+		//slots --tune 0.92 10 greedy 200000 1
+		TuneTarget target;
+		target.rtp = atof(argv[2]);
+		target.volatility = atof(argv[3]);
+		if ((argc >= 5 && !PolicyFromName(argv[4], target.policy)) || target.rtp <= 0 || target.volatility <= 0)
+		{
+			fprintf(stderr, "tune needs a positive rtp and volatility and a policy of spin, nudge or greedy\n");
+			return EXIT_FAILURE;
+		}
+		if (argc >= 6)
+			target.sessions = strtoull(argv[5], nullptr, 10);
+		if (argc >= 7)
+			target.seed = strtoull(argv[6], nullptr, 10);
+		Clock clock;
+		TuneResult best = TunePaytable(Paytable(), target);
+		printf("rtp %.4f volatility %.2f (score %g) in %.0fs\n", best.rtp, best.volatility, best.score, clock.getElapsedTime().asSeconds());
+		//ready to paste into GameRules.h
+		printf("CASH_PRIZES = {");
+		for (int i = 0; i < GC::NUM_FRUIT; ++i)
+			printf(i ? ", %d" : " %d", best.table.prizes[i]);
+		printf(" }\nNUDGE_COST = %d\nHOLD_COST = %d\nMAX_NUDGEHOLD = %d\n", best.table.nudgeCost, best.table.holdCost, best.table.maxNudgeHold);
+		return EXIT_SUCCESS;
+	}
+	if (cmd == "--shard-plan" && argc >= 5)
+	{
+		//slots --shard-plan run1 1000000000000 5000 greedy 1000 42
+		//writes run1/run.plan, then start workers on as many machines as can see run1
+		ShardPlan plan;
+		plan.sessions = strtoull(argv[3], nullptr, 10);
+		plan.numShards = (uint32_t)strtoul(argv[4], nullptr, 10);
+		if (argc >= 6 && !PolicyFromName(argv[5], plan.policy))
+		{
+			fprintf(stderr, "unknown policy %s, try spin, nudge or greedy\n", argv[5]);
+			return EXIT_FAILURE;
+		}
+		if (argc >= 7)
+			plan.maxSpins = atoi(argv[6]);
+		plan.seed = (argc >= 8) ? strtoull(argv[7], nullptr, 10) : (uint64_t)time(nullptr);
+		if (!CreateShardRun(argv[2], plan))
+		{
+			fprintf(stderr, "can't plan a run in %s\n", argv[2]);
+			return EXIT_FAILURE;
+		}
+		printf("%llu sessions in %u shards, policy %s, max spins %d, seed %llu\n", (unsigned long long)plan.sessions, plan.numShards,
+			PolicyName(plan.policy), plan.maxSpins, (unsigned long long)plan.seed);
+		return EXIT_SUCCESS;
+	}
+	if (cmd == "--shard-run" && argc >= 3)
+	{
+		//slots --shard-run run1 8 reclaim
+		//run it again after a crash to pick up where it left off
+		int numThreads = (argc >= 4) ? atoi(argv[3]) : 0;
+		bool reclaim = argc >= 5 && string(argv[4]) == "reclaim";
+		Clock clock;
+		int played = RunShardWorker(argv[2], numThreads, reclaim);
+		if (played < 0)
+		{
+			fprintf(stderr, "shard worker failed in %s\n", argv[2]);
+			return EXIT_FAILURE;
+		}
+		printf("played %d shards in %.0fs\n", played, clock.getElapsedTime().asSeconds());
+		return EXIT_SUCCESS;
+	}
+	if ((cmd == "--shard-launch" || cmd == "--shard-merge") && argc >= 3)
+	{
+		//slots --shard-launch run1 4
+		//slots --shard-merge run1 0 1 2
+		vector<uint32_t> shards;
+		Clock clock;
+		if (cmd == "--shard-launch")
+		{
+			//split the cores between the workers rather than have every process start one thread each
+			int numWorkers = (argc >= 4) ? max(1, atoi(argv[3])) : 1;
+			int threadsEach = max(1, (int)thread::hardware_concurrency() / numWorkers);
+			if (!LaunchShardWorkers(argv[0], argv[2], numWorkers, threadsEach))
+				fprintf(stderr, "some shard workers failed, merging what finished\n");
+		}
+		else
+		{
+			for (int i = 3; i < argc; ++i)
+				shards.push_back((uint32_t)strtoul(argv[i], nullptr, 10));
+		}
+		ShardPlan plan;
+		SessionStats stats;
+		vector<uint32_t> missing;
+		if (!ReadShardPlan(argv[2], plan) || !MergeShards(argv[2], shards, stats, missing))
+		{
+			fprintf(stderr, "no shard plan in %s\n", argv[2]);
+			return EXIT_FAILURE;
+		}
+		printf("policy %s, max spins %d, seed %llu, %.2fs\n", PolicyName(plan.policy), plan.maxSpins, (unsigned long long)plan.seed,
+			clock.getElapsedTime().asSeconds());
+		stats.Print(stdout);
+		printf("volatility %.2f\n", stats.Volatility(plan.table));
+		if (!missing.empty())
+		{
+			printf("%d shards not finished:", (int)missing.size());
+			for (size_t i = 0; i < missing.size() && i < 20; ++i)
+				printf(" %u", missing[i]);
+			printf(missing.size() > 20 ? " ...\n" : "\n");
+			return EXIT_FAILURE;
+		}
+		return EXIT_SUCCESS;
+	}
+	fprintf(stderr,
+		"usage:\n"
+		"  slots                                  play the game\n"
+		"  slots --export <player.db> <file>      write players out, .csv is text, anything else binary\n"
+		"  slots --import <player.db> <file>      read players in from an export\n"
+		"  slots --merge <floor.db> <k> <player.db>...  pull cabinets into the floor leaderboard, show the top k\n"
+		"  slots --bench-floor <floor.db> [readers] [seconds]  top k reads against live score posts\n"
+		"  slots --telemetry [name] [samples/s]  watch a running game's live numbers\n"
+		"  slots --fairness [outcomes] [seed]  statistical tests on the reel outcomes, fails if any do\n"
+		"  slots --ring-test [pushers] [poppers] [values each]  stress the lock-free ring the outcome pool uses\n"
+		"  slots --simulate <sessions> [spin|nudge|greedy] [max spins] [seed]  play sessions headless, show the odds\n"
+		"  slots --jackpot <spins> [policy] [tilt] [seed]  how often the jackpot pays, with confidence intervals\n"
+		"  slots --tune <rtp> <volatility> [policy] [sessions] [seed]  search for a paytable that hits the targets\n"
+		"  slots --shard-plan <dir> <sessions> <shards> [policy] [max spins] [seed]  split a big --simulate into shards\n"
+		"  slots --shard-run <dir> [threads] [reclaim]  play unfinished shards, from any machine that can see dir\n"
+		"  slots --shard-launch <dir> <workers>  play the shards in that many local processes, then merge\n"
+		"  slots --shard-merge <dir> [shard]...  add up the finished shards, all of them or just those listed\n");
+	return EXIT_FAILURE;
+}
+
+//*************************************************
+//open the window and play
+int RunGame()
+{
+	// Create the main window
+	RenderWindow window( VideoMode(1200, 800), "Slots!");
+	window.setVerticalSyncEnabled(true);
+
+	Game game;
+	game.Initialise(window);
+	game.Publish();
+
+	//hand the window over to the render thread, this thread just does input and updates
+	window.setActive(false);
+	atomic<bool> running(true);
+	thread renderer(RenderThread, ref(window), ref(game), ref(running));
+
+	Clock clock;
+	// Start the game loop 
+	while (!game.quit)
+	{
+		bool keyPress = false;
+		char key = 0;
+		// Process events
+		Event event;
+		while (window.pollEvent(event))
+		{
+			if (event.type == Event::KeyPressed)
+			{
+				keyPress = true;
+			}
+			else if (event.type == Event::TextEntered)
+			{
+				if (event.text.unicode < 128)
+					key = static_cast<char>(event.text.unicode);
+			}
+			else if (event.type == Event::Closed)
+			{
+				game.quit = true;
+			}
+		} 
+
+		GetFrameArena().Reset();
+		float elapsed = clock.getElapsedTime().asSeconds();
+		clock.restart();
+		
+		game.Update(window, elapsed, key, keyPress);
+		AddSecsToClock(elapsed);
+		game.Publish();
+
+		//no need to spin flat out, a millisecond is plenty for input and reel timing
+		sf::sleep(sf::milliseconds(1));
+	}
+
+	running = false;
+	renderer.join();
+	window.close();
+	game.Release();
+	return EXIT_SUCCESS;
+}
+
+//*************************************************
+//entry point
+int main(int argc, char *argv[])
+{
+	Log::Start(GC::LOG_FILE);
+	int result = (argc > 1) ? RunTool(argc, argv) : RunGame();
+	Log::Stop();
+	return result;
+}